@@ -23,6 +23,7 @@ LOCAL_SRC_FILES := \
 	$(MY_ROOT)/fitz/base_hash.c \
 	$(MY_ROOT)/fitz/base_memory.c \
 	$(MY_ROOT)/fitz/base_string.c \
+	$(MY_ROOT)/fitz/base_thread.c \
 	$(MY_ROOT)/fitz/base_time.c \
 	$(MY_ROOT)/fitz/crypt_aes.c \
 	$(MY_ROOT)/fitz/crypt_arc4.c \
@@ -54,6 +55,7 @@ LOCAL_SRC_FILES := \
 	$(MY_ROOT)/fitz/stm_buffer.c \
 	$(MY_ROOT)/fitz/stm_open.c \
 	$(MY_ROOT)/fitz/stm_read.c \
+	$(MY_ROOT)/fitz/stm_source.c \
 	$(MY_ROOT)/draw/archport.c \
 	$(MY_ROOT)/draw/blendmodes.c \
 	$(MY_ROOT)/draw/glyphcache.c \
@@ -87,6 +89,7 @@ LOCAL_SRC_FILES := \
 	$(MY_ROOT)/mupdf/pdf_nametree.c \
 	$(MY_ROOT)/mupdf/pdf_outline.c \
 	$(MY_ROOT)/mupdf/pdf_page.c \
+	$(MY_ROOT)/mupdf/pdf_prefetch.c \
 	$(MY_ROOT)/mupdf/pdf_pagetree.c \
 	$(MY_ROOT)/mupdf/pdf_parse.c \
 	$(MY_ROOT)/mupdf/pdf_pattern.c \
@@ -98,6 +101,7 @@ LOCAL_SRC_FILES := \
 	$(MY_ROOT)/mupdf/pdf_unicode.c \
 	$(MY_ROOT)/mupdf/pdf_xobject.c \
 	$(MY_ROOT)/mupdf/pdf_xref.c \
+	$(MY_ROOT)/mupdf/pdf_xrefindex.c \
 	$(MY_ROOT)/pregen/cmap_unicode.c \
 	$(MY_ROOT)/pregen/cmap_cns.c \
 	$(MY_ROOT)/pregen/cmap_gb.c \
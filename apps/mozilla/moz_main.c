@@ -121,14 +121,14 @@ void pdfmoz_open(pdfmoz_t *moz, char *filename)
 	moz->pages[i].page = nil;
 	moz->pages[i].image = nil;
 
-	obj = fz_dictgets(moz->pages[i].obj, "CropBox");
+	obj = pdf_lookupinherited(moz->pages[i].obj, "CropBox");
 	if (!obj)
-	    obj = fz_dictgets(moz->pages[i].obj, "MediaBox");
+	    obj = pdf_lookupinherited(moz->pages[i].obj, "MediaBox");
 	bbox = fz_roundrect(pdf_torect(obj));
 	moz->pages[i].w = bbox.x1 - bbox.x0;
 	moz->pages[i].h = bbox.y1 - bbox.y0;
 
-	rot = fz_toint(fz_dictgets(moz->pages[i].obj, "Rotate"));
+	rot = fz_toint(pdf_lookupinherited(moz->pages[i].obj, "Rotate"));
 	if ((rot / 90) % 2)
 	{
 	    int t = moz->pages[i].w;
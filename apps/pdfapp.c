@@ -294,7 +294,7 @@ static void pdfapp_showpage(pdfapp_t *app, int loadpage, int drawpage, int repai
 		fz_executedisplaylist(app->page->list, tdev, fz_identity);
 		fz_freedevice(tdev);
 
-		pdf_agestore(app->xref->store, 3);
+		pdf_agexref(app->xref, 3);
 	}
 
 	if (drawpage)
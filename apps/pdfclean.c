@@ -15,7 +15,7 @@
 static FILE *out = nil;
 
 static char *uselist = nil;
-static int *ofslist = nil;
+static fz_off_t *ofslist = nil;
 static int *genlist = nil;
 static int *renumbermap = nil;
 
@@ -271,6 +271,13 @@ static void renumberobjs(void)
 		uselist[num] = 1;
 }
 
+static void copyinherited(fz_obj *page, char *key)
+{
+	fz_obj *obj = pdf_lookupinherited(page, key);
+	if (obj && !fz_dictgets(page, key))
+		fz_dictputs(page, key, obj);
+}
+
 /*
  * Recreate page tree to only retain specified pages.
  */
@@ -339,6 +346,12 @@ static void retainpages(int argc, char **argv)
 				fz_obj *pageobj = pdf_getpageobject(xref, page);
 				fz_obj *pageref = pdf_getpageref(xref, page);
 
+				/* the nodes it inherited from are dropped with the old tree */
+				copyinherited(pageobj, "Resources");
+				copyinherited(pageobj, "MediaBox");
+				copyinherited(pageobj, "CropBox");
+				copyinherited(pageobj, "Rotate");
+
 				fz_dictputs(pageobj, "Parent", parent);
 
 				/* Store page object in new kids array */
@@ -371,6 +384,10 @@ static void preloadobjstms(void)
 	fz_obj *obj;
 	int num;
 
+	error = pdf_warmupxref(xref);
+	if (error)
+		die(error);
+
 	for (num = 0; num < xref->len; num++)
 	{
 		if (xref->table[num].type == 'o')
@@ -592,18 +609,18 @@ static void writexref(void)
 {
 	fz_obj *trailer;
 	fz_obj *obj;
-	int startxref;
+	fz_off_t startxref;
 	int num;
 
-	startxref = ftell(out);
+	startxref = ftello(out);
 
 	fprintf(out, "xref\n0 %d\n", xref->len);
 	for (num = 0; num < xref->len; num++)
 	{
 		if (uselist[num])
-			fprintf(out, "%010d %05d n \n", ofslist[num], genlist[num]);
+			fprintf(out, "%010lld %05d n \n", ofslist[num], genlist[num]);
 		else
-			fprintf(out, "%010d %05d f \n", ofslist[num], genlist[num]);
+			fprintf(out, "%010lld %05d f \n", ofslist[num], genlist[num]);
 	}
 	fprintf(out, "\n");
 
@@ -631,7 +648,7 @@ static void writexref(void)
 
 	fz_dropobj(trailer);
 
-	fprintf(out, "startxref\n%d\n%%%%EOF\n", startxref);
+	fprintf(out, "startxref\n%lld\n%%%%EOF\n", startxref);
 }
 
 static void writepdf(void)
@@ -654,7 +671,7 @@ static void writepdf(void)
 		if (xref->table[num].type == 'n' || xref->table[num].type == 'o')
 		{
 			uselist[num] = 1;
-			ofslist[num] = ftell(out);
+			ofslist[num] = ftello(out);
 			writeobject(num, genlist[num]);
 		}
 	}
@@ -714,6 +731,11 @@ int main(int argc, char **argv)
 	if (error)
 		die(fz_rethrow(error, "cannot open input file '%s'", infile));
 
+	/* every object is written out, so read all of the xref */
+	error = pdf_loadlazyxref(xref);
+	if (error)
+		die(fz_rethrow(error, "cannot load xref of '%s'", infile));
+
 	out = fopen(outfile, "wb");
 	if (!out)
 		die(fz_throw("cannot open output file '%s'", outfile));
@@ -722,7 +744,7 @@ int main(int argc, char **argv)
 	fprintf(out, "%%\316\274\341\277\246\n\n");
 
 	uselist = fz_calloc(xref->len + 1, sizeof(char));
-	ofslist = fz_calloc(xref->len + 1, sizeof(int));
+	ofslist = fz_calloc(xref->len + 1, sizeof(fz_off_t));
 	genlist = fz_calloc(xref->len + 1, sizeof(int));
 	renumbermap = fz_calloc(xref->len + 1, sizeof(int));
 
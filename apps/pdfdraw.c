@@ -21,6 +21,7 @@ int showtime = 0;
 int showmd5 = 0;
 int savealpha = 0;
 int uselist = 1;
+int prefetch = 0;
 
 fz_colorspace *colorspace;
 fz_glyphcache *glyphcache;
@@ -53,6 +54,8 @@ static void usage(void)
 		"\t-t\tshow text (-tt for xml)\n"
 		"\t-x\tshow display list\n"
 		"\t-d\tdisable use of display list\n"
+		"\t-P\tread the next page ahead in the background\n"
+		"\t-i\tkeep an xref index in input.pdf.idx for faster reopening\n"
 		"\t-5\tshow md5 checksums\n"
 		"\t-R -\trotate clockwise by given number of degrees\n"
 		"\tpages\tcomma separated list of ranges\n");
@@ -84,10 +87,11 @@ static int isrange(char *s)
 	return 1;
 }
 
-static void drawpage(pdf_xref *xref, int pagenum)
+static void drawpage(pdf_xref *xref, int pagenum, int nextpage)
 {
 	fz_error error;
 	fz_obj *pageobj;
+	pdf_prefetch *pf;
 	pdf_page *page;
 	fz_displaylist *list;
 	fz_device *dev;
@@ -103,6 +107,10 @@ static void drawpage(pdf_xref *xref, int pagenum)
 	if (error)
 		die(fz_rethrow(error, "cannot load page %d in file '%s'", pagenum, filename));
 
+	pf = nil;
+	if (prefetch && nextpage)
+		pf = pdf_prefetchpage(xref, pdf_getpageobject(xref, nextpage));
+
 	list = nil;
 
 	if (uselist)
@@ -237,7 +245,9 @@ static void drawpage(pdf_xref *xref, int pagenum)
 	if (showmd5 || showtime)
 		printf("\n");
 
-	pdf_agestore(xref->store, 3);
+	pdf_finishprefetch(pf);
+
+	pdf_agexref(xref, 3);
 
 	fz_flushwarnings();
 }
@@ -270,10 +280,10 @@ static void drawrange(pdf_xref *xref, char *range)
 
 		if (spage < epage)
 			for (page = spage; page <= epage; page++)
-				drawpage(xref, page);
+				drawpage(xref, page, page < epage ? page + 1 : 0);
 		else
 			for (page = spage; page >= epage; page--)
-				drawpage(xref, page);
+				drawpage(xref, page, page > epage ? page - 1 : 0);
 
 		spec = fz_strsep(&range, ",");
 	}
@@ -284,11 +294,13 @@ int main(int argc, char **argv)
 	char *password = "";
 	int grayscale = 0;
 	int accelerate = 1;
+	int useindex = 0;
+	char indexname[1024];
 	pdf_xref *xref;
 	fz_error error;
 	int c;
 
-	while ((c = fz_getopt(argc, argv, "o:p:r:R:Aadgmtx5")) != -1)
+	while ((c = fz_getopt(argc, argv, "o:p:r:R:AadgimtxP5")) != -1)
 	{
 		switch (c)
 		{
@@ -304,6 +316,8 @@ int main(int argc, char **argv)
 		case '5': showmd5++; break;
 		case 'g': grayscale++; break;
 		case 'd': uselist = 0; break;
+		case 'P': prefetch = 1; break;
+		case 'i': useindex = 1; break;
 		default: usage(); break;
 		}
 	}
@@ -344,7 +358,13 @@ int main(int argc, char **argv)
 	{
 		filename = argv[fz_optind++];
 
-		error = pdf_openxref(&xref, filename, password);
+		if (useindex)
+		{
+			snprintf(indexname, sizeof indexname, "%s.idx", filename);
+			error = pdf_openxrefwithindex(&xref, filename, password, indexname);
+		}
+		else
+			error = pdf_openxref(&xref, filename, password);
 		if (error)
 			die(fz_rethrow(error, "cannot open document: %s", filename));
 
@@ -363,6 +383,13 @@ int main(int argc, char **argv)
 		if (showxml)
 			printf("</document>\n");
 
+		if (showtime > 1)
+		{
+			pdf_debugstreamcache(xref);
+			pdf_debugcodecache(xref);
+			pdf_debugstorestats(xref->store);
+		}
+
 		pdf_freexref(xref);
 	}
 
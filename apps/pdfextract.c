@@ -51,6 +51,14 @@ static void saveimage(int num)
 	if (error)
 		die(error);
 
+	if (img->lookup)
+	{
+		fz_pixmap *temp;
+		temp = fz_unpackpixmap(img);
+		fz_droppixmap(img);
+		img = temp;
+	}
+
 	if (dorgb && img->colorspace && img->colorspace != fz_devicergb)
 	{
 		fz_pixmap *temp;
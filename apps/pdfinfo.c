@@ -208,7 +208,7 @@ gatherdimensions(int page, fz_obj *pageref, fz_obj *pageobj)
 	fz_obj *obj;
 	int j;
 
-	obj = fz_dictgets(pageobj, "MediaBox");
+	obj = pdf_lookupinherited(pageobj, "MediaBox");
 	if (!fz_isarray(obj))
 		return;
 
@@ -640,7 +640,7 @@ gatherpageinfo(int page)
 
 	gatherdimensions(page, pageref, pageobj);
 
-	rsrc = fz_dictgets(pageobj, "Resources");
+	rsrc = pdf_lookupinherited(pageobj, "Resources");
 	gatherresourceinfo(page, rsrc);
 }
 
@@ -169,6 +169,10 @@ static void showgrep(char *filename)
 	fz_obj *obj;
 	int i;
 
+	error = pdf_warmupxref(xref);
+	if (error)
+		die(error);
+
 	for (i = 0; i < xref->len; i++)
 	{
 		if (xref->table[i].type == 'n' || xref->table[i].type == 'o')
@@ -263,6 +263,124 @@ fz_paintaffinecolornear(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa
 	}
 }
 
+/*
+ * Packed images are sampled through their lookup table. These handle the
+ * plain, constant alpha and color mask cases in one loop; the per-pixel
+ * bit extraction costs more than the branches.
+ */
+
+static inline byte *
+samplepacked(fz_pixmap *img, int stride, int u, int v)
+{
+	int bpc = img->bpc;
+	int bit;
+	byte *s;
+	if (u < 0) u = 0;
+	if (v < 0) v = 0;
+	if (u >= img->w) u = img->w - 1;
+	if (v >= img->h) v = img->h - 1;
+	bit = u * bpc;
+	s = img->samples + v * stride + (bit >> 3);
+	return img->lookup + ((*s >> (8 - bpc - (bit & 7))) & ((1 << bpc) - 1)) * img->n;
+}
+
+static void
+fz_paintaffinepackedlerp(byte *dp, fz_pixmap *img, int u, int v, int fa, int fb, int w, int n, int alpha, byte *color)
+{
+	int stride = (img->w * img->bpc + 7) / 8;
+	int sw = img->w;
+	int sh = img->h;
+	int sn = img->n;
+	int k;
+
+	while (w--)
+	{
+		int ui = u >> 16;
+		int vi = v >> 16;
+		if (ui >= 0 && ui < sw && vi >= 0 && vi < sh)
+		{
+			int uf = u & 0xffff;
+			int vf = v & 0xffff;
+			byte *a = samplepacked(img, stride, ui, vi);
+			byte *b = samplepacked(img, stride, ui+1, vi);
+			byte *c = samplepacked(img, stride, ui, vi+1);
+			byte *d = samplepacked(img, stride, ui+1, vi+1);
+			if (color)
+			{
+				int ma = bilerp(a[0], b[0], c[0], d[0], uf, vf);
+				int masa = FZ_COMBINE(FZ_EXPAND(ma), color[n-1]);
+				for (k = 0; k < n - 1; k++)
+					dp[k] = FZ_BLEND(color[k], dp[k], masa);
+				dp[k] = FZ_BLEND(255, dp[k], masa);
+			}
+			else if (alpha == 255)
+			{
+				int t = 255 - bilerp(a[sn-1], b[sn-1], c[sn-1], d[sn-1], uf, vf);
+				for (k = 0; k < n; k++)
+				{
+					int x = bilerp(a[k], b[k], c[k], d[k], uf, vf);
+					dp[k] = x + fz_mul255(dp[k], t);
+				}
+			}
+			else
+			{
+				int x = bilerp(a[sn-1], b[sn-1], c[sn-1], d[sn-1], uf, vf);
+				int t = 255 - fz_mul255(x, alpha);
+				for (k = 0; k < n; k++)
+				{
+					x = bilerp(a[k], b[k], c[k], d[k], uf, vf);
+					dp[k] = fz_mul255(x, alpha) + fz_mul255(dp[k], t);
+				}
+			}
+		}
+		dp += n;
+		u += fa;
+		v += fb;
+	}
+}
+
+static void
+fz_paintaffinepackednear(byte *dp, fz_pixmap *img, int u, int v, int fa, int fb, int w, int n, int alpha, byte *color)
+{
+	int stride = (img->w * img->bpc + 7) / 8;
+	int sw = img->w;
+	int sh = img->h;
+	int sn = img->n;
+	int k;
+
+	while (w--)
+	{
+		int ui = u >> 16;
+		int vi = v >> 16;
+		if (ui >= 0 && ui < sw && vi >= 0 && vi < sh)
+		{
+			byte *sample = samplepacked(img, stride, ui, vi);
+			if (color)
+			{
+				int masa = FZ_COMBINE(FZ_EXPAND(sample[0]), color[n-1]);
+				for (k = 0; k < n - 1; k++)
+					dp[k] = FZ_BLEND(color[k], dp[k], masa);
+				dp[k] = FZ_BLEND(255, dp[k], masa);
+			}
+			else if (alpha == 255)
+			{
+				int t = 255 - sample[sn-1];
+				for (k = 0; k < n; k++)
+					dp[k] = sample[k] + fz_mul255(dp[k], t);
+			}
+			else
+			{
+				int t = 255 - fz_mul255(sample[sn-1], alpha);
+				for (k = 0; k < n; k++)
+					dp[k] = fz_mul255(sample[k], alpha) + fz_mul255(dp[k], t);
+			}
+		}
+		dp += n;
+		u += fa;
+		v += fb;
+	}
+}
+
 /* Draw an image with an affine transform on destination */
 
 static void
@@ -329,6 +447,23 @@ fz_paintimageimp(fz_pixmap *dst, fz_bbox scissor, fz_pixmap *img, fz_matrix ctm,
 
 	/* TODO: if (fb == 0 && fa == 1) call fz_paintspan */
 
+	if (img->lookup)
+	{
+		if (!color && alpha == 0)
+			return;
+		while (h--)
+		{
+			if (dolerp)
+				fz_paintaffinepackedlerp(dp, img, u, v, fa, fb, w, n, alpha, color);
+			else
+				fz_paintaffinepackednear(dp, img, u, v, fa, fb, w, n, alpha, color);
+			dp += dst->w * n;
+			u += fc;
+			v += fd;
+		}
+		return;
+	}
+
 	while (h--)
 	{
 		if (dolerp)
@@ -364,3 +499,181 @@ fz_paintimage(fz_pixmap *dst, fz_bbox scissor, fz_pixmap *img, fz_matrix ctm, in
 	assert(dst->n == img->n);
 	fz_paintimageimp(dst, scissor, img, ctm, nil, alpha);
 }
+
+/*
+ * Bilevel (1 bit packed) images drawn upright at 1:1 or at an integer
+ * downscale, which is how fax and JBIG2 scans are usually viewed, are
+ * painted a row at a time from the runs of set bits. Whole bytes of
+ * background are skipped when looking for runs, the coverage of each
+ * k by k block is counted from the run lengths, and the resulting row is
+ * blitted with the span painters.
+ *
+ * The transform is grid fitted as in fz_paintimageimp and must already
+ * be a whole number of pixels in size, so that output at 1:1 is the
+ * same as from the general path.
+ *
+ * Returns 0 without painting if the image or transform don't qualify.
+ */
+
+static inline int
+findbit(const byte *line, int x, int w, int bit)
+{
+	const byte skip = bit ? 0x00 : 0xFF;
+	while (x < w)
+	{
+		if ((x & 7) == 0)
+		{
+			while (x + 8 <= w && line[x >> 3] == skip)
+				x += 8;
+			if (x >= w)
+				break;
+		}
+		if (((line[x >> 3] >> (7 - (x & 7))) & 1) == bit)
+			return x;
+		x++;
+	}
+	return w;
+}
+
+static inline void
+addrun(int *count, int x0, int x1, int k)
+{
+	int c0 = x0 / k;
+	int c1 = (x1 - 1) / k;
+	int c;
+
+	if (c0 == c1)
+	{
+		count[c0] += x1 - x0;
+		return;
+	}
+
+	count[c0] += (c0 + 1) * k - x0;
+	for (c = c0 + 1; c < c1; c++)
+		count[c] += k;
+	count[c1] += x1 - c1 * k;
+}
+
+int
+fz_paintimagebilevel(fz_pixmap *dst, fz_bbox scissor, fz_pixmap *img, fz_matrix ctm, byte *color, int alpha)
+{
+	byte *l0, *l1, *row, *dp;
+	int *count;
+	int w, h, k, n, stride;
+	int x0, y0, ow, oh;
+	float a, d;
+	int ox, oy, sx, sy, sy1;
+	int i, j;
+	fz_bbox bbox;
+
+	if (!img->lookup || img->bpc != 1)
+		return 0;
+	if (ctm.b != 0 || ctm.c != 0 || ctm.a <= 0 || ctm.d >= 0)
+		return 0;
+	if (!color && dst->n != img->n)
+		return 0;
+
+	/* grid fit as fz_paintimageimp does */
+	a = roundup(ctm.a);
+	d = roundup(ctm.d);
+	if (a != ctm.a || d != ctm.d)
+		return 0;
+
+	w = img->w;
+	h = img->h;
+	k = floorf(w / a + 0.5f);
+	if (k < 1)
+		return 0;
+	ow = (w + k - 1) / k;
+	oh = (h + k - 1) / k;
+	if (ow != a || oh != -d)
+		return 0;
+
+	if (alpha == 0)
+		return 1;
+
+	x0 = floorf(ctm.e);
+	y0 = floorf(ctm.f) + d;
+
+	bbox.x0 = x0;
+	bbox.y0 = y0;
+	bbox.x1 = x0 + ow;
+	bbox.y1 = y0 + oh;
+	bbox = fz_intersectbbox(bbox, scissor);
+	bbox = fz_intersectbbox(bbox, fz_boundpixmap(dst));
+	if (fz_isemptybbox(bbox))
+		return 1;
+
+	n = color ? 1 : img->n;
+	l0 = img->lookup;
+	l1 = img->lookup + img->n;
+	stride = (w + 7) >> 3;
+
+	count = fz_calloc(ow, sizeof(int));
+	row = fz_calloc(ow, n);
+
+	for (oy = bbox.y0 - y0; oy < bbox.y1 - y0; oy++)
+	{
+		memset(count, 0, ow * sizeof(int));
+
+		sy1 = MIN(oy * k + k, h);
+		for (sy = oy * k; sy < sy1; sy++)
+		{
+			byte *line = img->samples + sy * stride;
+			sx = findbit(line, 0, w, 1);
+			while (sx < w)
+			{
+				int ex = findbit(line, sx, w, 0);
+				addrun(count, sx, ex, k);
+				sx = findbit(line, ex, w, 1);
+			}
+		}
+
+		for (ox = bbox.x0 - x0; ox < bbox.x1 - x0; ox++)
+		{
+			byte *rp = row + ox * n;
+			if (k == 1)
+			{
+				byte *lp = count[ox] ? l1 : l0;
+				for (j = 0; j < n; j++)
+					rp[j] = lp[j];
+			}
+			else
+			{
+				int area = (sy1 - oy * k) * MIN(k, w - ox * k);
+				int c1 = count[ox];
+				int c0 = area - c1;
+				for (j = 0; j < n; j++)
+					rp[j] = (l0[j] * c0 + l1[j] * c1 + (area >> 1)) / area;
+			}
+		}
+
+		dp = dst->samples + ((y0 + oy - dst->y) * dst->w + (bbox.x0 - dst->x)) * dst->n;
+
+		if (color)
+		{
+			/* paint only the spans with some coverage */
+			ox = bbox.x0 - x0;
+			while (ox < bbox.x1 - x0)
+			{
+				if (row[ox] == 0)
+				{
+					ox++;
+					continue;
+				}
+				for (i = ox; i < bbox.x1 - x0 && row[i] != 0; i++)
+					;
+				fz_paintspancolor(dp + (ox - (bbox.x0 - x0)) * dst->n, row + ox, dst->n, i - ox, color);
+				ox = i;
+			}
+		}
+		else
+		{
+			fz_paintspan(dp, row + (bbox.x0 - x0) * n, n, bbox.x1 - bbox.x0, alpha);
+		}
+	}
+
+	fz_free(row);
+	fz_free(count);
+	return 1;
+}
@@ -234,6 +234,14 @@ fz_scalepixmap(fz_pixmap *src, int xdenom, int ydenom)
 	void (*srowx)(byte * restrict src, byte * restrict dst, int w, int denom) = nil;
 	void (*scolx)(byte * restrict src, byte * restrict dst, int w, int denom) = nil;
 
+	if (src->lookup)
+	{
+		fz_pixmap *unpacked = fz_unpackpixmap(src);
+		dst = fz_scalepixmap(unpacked, xdenom, ydenom);
+		fz_droppixmap(unpacked);
+		return dst;
+	}
+
 	ow = (src->w + xdenom - 1) / xdenom;
 	oh = (src->h + ydenom - 1) / ydenom;
 	n = src->n;
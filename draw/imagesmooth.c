@@ -16,6 +16,12 @@ and then positioning it at (frac(x),frac(y)).
  */
 #define SINGLE_PIXEL_SPECIALS
 
+/* The RGBA row scaler has an SSE4.1 version when the compiler targets it
+ * (build=native, or -msse4.1). */
+#if defined(__SSE4_1__) && !defined(ARCH_ARM)
+#include <smmintrin.h>
+#endif
+
 #ifdef DEBUG_SCALING
 #ifdef WIN32
 #include <windows.h>
@@ -703,6 +709,22 @@ scale_row_to_temp4(int *dst, unsigned char *src, fz_weights *weights)
 		"r4","r5","r6","r7","r8","r9","r10","r11","r12","r14",
 		"memory","cc"
 		);
+#elif defined(__SSE4_1__)
+		for (i=weights->count; i > 0; i--)
+		{
+			__m128i acc = _mm_setzero_si128();
+			min = &src[4 * *contrib++];
+			len = *contrib++;
+			while (len-- > 0)
+			{
+				int px;
+				memcpy(&px, min, 4);
+				acc = _mm_add_epi32(acc, _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(px)), _mm_set1_epi32(*contrib++)));
+				min += 4;
+			}
+			dst -= 4;
+			_mm_storeu_si128((__m128i *)dst, acc);
+		}
 #else
 		for (i=weights->count; i > 0; i--)
 		{
@@ -766,6 +788,22 @@ scale_row_to_temp4(int *dst, unsigned char *src, fz_weights *weights)
 		"r4","r5","r6","r7","r8","r9","r10","r11","r12","r14",
 		"memory","cc"
 		);
+#elif defined(__SSE4_1__)
+		for (i=weights->count; i > 0; i--)
+		{
+			__m128i acc = _mm_setzero_si128();
+			min = &src[4 * *contrib++];
+			len = *contrib++;
+			while (len-- > 0)
+			{
+				int px;
+				memcpy(&px, min, 4);
+				acc = _mm_add_epi32(acc, _mm_mullo_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(px)), _mm_set1_epi32(*contrib++)));
+				min += 4;
+			}
+			_mm_storeu_si128((__m128i *)dst, acc);
+			dst += 4;
+		}
 #else
 		for (i=weights->count; i > 0; i--)
 		{
@@ -792,32 +830,105 @@ scale_row_to_temp4(int *dst, unsigned char *src, fz_weights *weights)
 }
 
 static void
-scale_row_from_temp(unsigned char *dst, int *src, fz_weights *weights, int width, int row)
+scale_row_to_temp5(int *dst, unsigned char *src, fz_weights *weights)
+{
+	int *contrib = &weights->index[weights->index[0]];
+	int len, i;
+	unsigned char *min;
+
+	assert(weights->n == 5);
+	if (weights->flip)
+	{
+		dst += 5*weights->count;
+		for (i=weights->count; i > 0; i--)
+		{
+			int c = 0;
+			int m = 0;
+			int y = 0;
+			int k = 0;
+			int a = 0;
+			min = &src[5 * *contrib++];
+			len = *contrib++;
+			while (len-- > 0)
+			{
+				c += *min++ * *contrib;
+				m += *min++ * *contrib;
+				y += *min++ * *contrib;
+				k += *min++ * *contrib;
+				a += *min++ * *contrib++;
+			}
+			*--dst = a;
+			*--dst = k;
+			*--dst = y;
+			*--dst = m;
+			*--dst = c;
+		}
+	}
+	else
+	{
+		for (i=weights->count; i > 0; i--)
+		{
+			int c = 0;
+			int m = 0;
+			int y = 0;
+			int k = 0;
+			int a = 0;
+			min = &src[5 * *contrib++];
+			len = *contrib++;
+			while (len-- > 0)
+			{
+				c += *min++ * *contrib;
+				m += *min++ * *contrib;
+				y += *min++ * *contrib;
+				k += *min++ * *contrib;
+				a += *min++ * *contrib++;
+			}
+			*dst++ = c;
+			*dst++ = m;
+			*dst++ = y;
+			*dst++ = k;
+			*dst++ = a;
+		}
+	}
+}
+
+/*
+The vertical pass walks the contributing temp rows in turn, accumulating
+whole rows into acc. This keeps the inner loop running over contiguous
+memory with a single weight, which compilers turn into vector code,
+rather than striding down the temp buffer for every output sample.
+*/
+static void
+scale_row_from_temp(unsigned char * restrict dst, int * restrict src, fz_weights *weights, int width, int row, int * restrict acc)
 {
 	int *contrib = &weights->index[weights->index[row]];
 	int len, x;
 
 	contrib++; /* Skip min */
 	len = *contrib++;
-	for (x=width; x > 0; x--)
-	{
-		int *min = src;
-		int val = 0;
-		int len2 = len;
-		int *contrib2 = contrib;
 
-		while (len2-- > 0)
+	for (x = 0; x < width; x++)
+		acc[x] = 1<<15;
+
+	while (len-- > 0)
+	{
+		int weight = *contrib++;
+		if (weight != 0)
 		{
-			val += *min * *contrib2++;
-			min += width;
+			for (x = 0; x < width; x++)
+				acc[x] += src[x] * weight;
 		}
-		val = (val+(1<<15))>>16;
+		src += width;
+	}
+
+	for (x = 0; x < width; x++)
+	{
+		int val = acc[x]>>16;
 		if (val < 0)
 			val = 0;
 		else if (val > 255)
 			val = 255;
-		*dst++ = val;
-		src++;
+		dst[x] = val;
 	}
 }
 
@@ -988,6 +1099,90 @@ scale_single_col(unsigned char *dst, unsigned char *src, fz_weights *weights, in
 }
 #endif /* SINGLE_PIXEL_SPECIALS */
 
+/*
+The vertical pass for large images is split into bands of output rows,
+one per worker thread. Each band owns its own temp ring buffer and
+horizontally scales the source rows it needs itself, so bands that share
+a source row at their boundary both scale it; that overlap is a few rows
+at most. The weights for the ring buffer are ordered by absolute source
+row modulo the ring size, so a band may start anywhere.
+*/
+
+/* don't bother with threads for fewer source samples than this */
+#define MINTHREADSAMPLES (1 << 20)
+#define MAXTHREADS 16
+
+typedef struct fz_scaleband_s fz_scaleband;
+
+struct fz_scaleband_s
+{
+	fz_pixmap *src;
+	fz_pixmap *dst;
+	fz_weights *rows;
+	fz_weights *cols;
+	void (*row_scale)(int *dst, unsigned char *src, fz_weights *weights);
+	int flip_y;
+	int row0, row1;
+};
+
+static void
+scale_band(void *arg)
+{
+	fz_scaleband *band = arg;
+	fz_pixmap *src = band->src;
+	fz_pixmap *dst = band->dst;
+	fz_weights *contrib_rows = band->rows;
+	int temp_span = band->cols->count * src->n;
+	int temp_rows = contrib_rows->max_len;
+	int *temp, *acc;
+	unsigned char *unpacked = nil;
+	int row, max_row;
+
+	temp = fz_calloc(temp_span*temp_rows, sizeof(int));
+	acc = fz_calloc(temp_span, sizeof(int));
+
+	/* packed source rows are expanded one at a time as they are needed */
+	if (src->lookup)
+		unpacked = fz_calloc(src->w, src->n);
+
+	/* start with the first source row the band needs */
+	max_row = contrib_rows->index[contrib_rows->index[band->row0]];
+
+	for (row = band->row0; row < band->row1; row++)
+	{
+		/*
+		Which source rows do we need to have scaled into the
+		temporary buffer in order to be able to do the final
+		scale?
+		*/
+		int row_index = contrib_rows->index[row];
+		int row_min = contrib_rows->index[row_index++];
+		int row_len = contrib_rows->index[row_index++];
+		while (max_row < row_min+row_len)
+		{
+			/* Scale another row */
+			int src_row = band->flip_y ? (src->h-1-max_row) : max_row;
+			assert(max_row < src->h);
+			DBUG(("scaling row %d to temp\n", max_row));
+			if (unpacked)
+			{
+				fz_unpackpixmaprow(src, src_row, unpacked);
+				(*band->row_scale)(&temp[temp_span*(max_row % temp_rows)], unpacked, band->cols);
+			}
+			else
+				(*band->row_scale)(&temp[temp_span*(max_row % temp_rows)], &src->samples[src_row*src->w*src->n], band->cols);
+			max_row++;
+		}
+
+		DBUG(("scaling row %d from temp\n", row));
+		scale_row_from_temp(&dst->samples[row*dst->w*dst->n], temp, contrib_rows, temp_span, row, acc);
+	}
+
+	fz_free(unpacked);
+	fz_free(acc);
+	fz_free(temp);
+}
+
 fz_pixmap *
 fz_smoothscalepixmap(fz_pixmap *src, float x, float y, float w, float h)
 {
@@ -995,8 +1190,8 @@ fz_smoothscalepixmap(fz_pixmap *src, float x, float y, float w, float h)
 	fz_weights *contrib_rows = NULL;
 	fz_weights *contrib_cols = NULL;
 	fz_pixmap *output = NULL;
-	int *temp = NULL;
-	int max_row, temp_span, temp_rows, row;
+	fz_pixmap *unpacked = NULL;
+	int temp_span, temp_rows;
 	int dst_w_int, dst_h_int, dst_x_int, dst_y_int;
 	int flip_x, flip_y;
 
@@ -1096,6 +1291,13 @@ fz_smoothscalepixmap(fz_pixmap *src, float x, float y, float w, float h)
 
 	/* Step 2: Apply the weights */
 #ifdef SINGLE_PIXEL_SPECIALS
+	if (src->lookup && (contrib_rows == NULL || contrib_cols == NULL))
+	{
+		/* The single row and column scalers want plain samples */
+		unpacked = fz_unpackpixmap(src);
+		src = unpacked;
+	}
+
 	if (contrib_rows == NULL)
 	{
 		/* Only 1 source pixel high. */
@@ -1118,57 +1320,64 @@ fz_smoothscalepixmap(fz_pixmap *src, float x, float y, float w, float h)
 	else
 #endif /* SINGLE_PIXEL_SPECIALS */
 	{
-		void (*row_scale)(int *dst, unsigned char *src, fz_weights *weights);
+		fz_scaleband bands[MAXTHREADS];
+		fz_thread *threads[MAXTHREADS];
+		int i, nbands;
 
 		temp_span = contrib_cols->count * src->n;
 		temp_rows = contrib_rows->max_len;
 		if (temp_span <= 0 || temp_rows > INT_MAX / temp_span)
-			goto cleanup;
-		temp = fz_calloc(temp_span*temp_rows, sizeof(int));
-		if (temp == NULL)
-			goto cleanup;
-		switch (src->n)
 		{
-		default:
-			row_scale = scale_row_to_temp;
-			break;
-		case 1: /* Image mask case */
-			row_scale = scale_row_to_temp1;
-			break;
-		case 2: /* Greyscale with alpha case */
-			row_scale = scale_row_to_temp2;
-			break;
-		case 4: /* RGBA */
-			row_scale = scale_row_to_temp4;
-			break;
+			fz_droppixmap(output);
+			output = NULL;
+			goto cleanup;
 		}
-		max_row = 0;
-		for (row = 0; row < contrib_rows->count; row++)
+
+		nbands = 1;
+		if (src->w * src->h >= MINTHREADSAMPLES)
+			nbands = CLAMP(fz_cpucount(), 1, MIN(MAXTHREADS, dst_h_int / 16));
+		nbands = MAX(nbands, 1);
+
+		for (i = 0; i < nbands; i++)
 		{
-			/*
-			Which source rows do we need to have scaled into the
-			temporary buffer in order to be able to do the final
-			scale?
-			*/
-			int row_index = contrib_rows->index[row];
-			int row_min = contrib_rows->index[row_index++];
-			int row_len = contrib_rows->index[row_index++];
-			while (max_row < row_min+row_len)
+			bands[i].src = src;
+			bands[i].dst = output;
+			bands[i].rows = contrib_rows;
+			bands[i].cols = contrib_cols;
+			bands[i].flip_y = flip_y;
+			bands[i].row0 = (int)((long long)dst_h_int * i / nbands);
+			bands[i].row1 = (int)((long long)dst_h_int * (i + 1) / nbands);
+			switch (src->n)
 			{
-				/* Scale another row */
-				assert(max_row < src->h);
-				DBUG(("scaling row %d to temp\n", max_row));
-				(*row_scale)(&temp[temp_span*(max_row % temp_rows)], &src->samples[(flip_y ? (src->h-1-max_row): max_row)*src->w*src->n], contrib_cols);
-				max_row++;
+			default:
+				bands[i].row_scale = scale_row_to_temp;
+				break;
+			case 1: /* Image mask case */
+				bands[i].row_scale = scale_row_to_temp1;
+				break;
+			case 2: /* Greyscale with alpha case */
+				bands[i].row_scale = scale_row_to_temp2;
+				break;
+			case 4: /* RGBA */
+				bands[i].row_scale = scale_row_to_temp4;
+				break;
+			case 5: /* CMYK */
+				bands[i].row_scale = scale_row_to_temp5;
+				break;
 			}
-
-			DBUG(("scaling row %d from temp\n", row));
-			scale_row_from_temp(&output->samples[row*output->w*output->n], temp, contrib_rows, temp_span, row);
 		}
-		fz_free(temp);
+
+		/* the calling thread takes the first band itself */
+		for (i = 1; i < nbands; i++)
+			threads[i] = fz_newthread(scale_band, &bands[i]);
+		scale_band(&bands[0]);
+		for (i = 1; i < nbands; i++)
+			fz_jointhread(threads[i]);
 	}
 
 cleanup:
+	if (unpacked)
+		fz_droppixmap(unpacked);
 	fz_free(contrib_rows);
 	fz_free(contrib_cols);
 	return output;
@@ -2,8 +2,23 @@
 
 enum { LINELEN = 160, LINECOUNT = 25 };
 
-static char warnmessage[LINELEN] = "";
-static int warncount = 0;
+/*
+ * Each thread keeps its own error chain and repeated warning, so that
+ * a throw on one thread cannot reset or interleave with the chain
+ * another thread is building. Threads other than the main one should
+ * call fz_flushwarnings before they exit.
+ */
+
+#if defined(NOTHREADS)
+#define THREADLOCAL
+#elif defined(_MSC_VER)
+#define THREADLOCAL __declspec(thread)
+#else
+#define THREADLOCAL __thread
+#endif
+
+static THREADLOCAL char warnmessage[LINELEN] = "";
+static THREADLOCAL int warncount = 0;
 
 void fz_flushwarnings(void)
 {
@@ -35,8 +50,8 @@ void fz_warn(char *fmt, ...)
 	}
 }
 
-static char errormessage[LINECOUNT][LINELEN];
-static int errorcount = 0;
+static THREADLOCAL char errormessage[LINECOUNT][LINELEN];
+static THREADLOCAL int errorcount = 0;
 
 static void
 fz_emiterror(char what, char *location, char *message)
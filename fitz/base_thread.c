@@ -0,0 +1,171 @@
+#include "fitz.h"
+
+/*
+ * Minimal portable threads and mutexes.
+ *
+ * Define NOTHREADS to build without a thread library; fz_newthread then
+ * runs the function to completion before returning and the mutex calls
+ * do nothing.
+ */
+
+#if defined(NOTHREADS)
+
+struct fz_thread_s { int dummy; };
+struct fz_mutex_s { int dummy; };
+
+#elif defined(_WIN32)
+
+#include <windows.h>
+
+struct fz_thread_s
+{
+	HANDLE handle;
+	void (*func)(void *arg);
+	void *arg;
+};
+
+struct fz_mutex_s
+{
+	CRITICAL_SECTION cs;
+};
+
+static DWORD WINAPI
+fz_threadstart(LPVOID arg)
+{
+	fz_thread *thread = arg;
+	thread->func(thread->arg);
+	return 0;
+}
+
+#else
+
+#include <pthread.h>
+
+struct fz_thread_s
+{
+	pthread_t handle;
+	int running;
+	void (*func)(void *arg);
+	void *arg;
+};
+
+struct fz_mutex_s
+{
+	pthread_mutex_t mutex;
+};
+
+static void *
+fz_threadstart(void *arg)
+{
+	fz_thread *thread = arg;
+	thread->func(thread->arg);
+	return nil;
+}
+
+#endif
+
+int
+fz_cpucount(void)
+{
+#if defined(NOTHREADS)
+	return 1;
+#elif defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return MAX(1, info.dwNumberOfProcessors);
+#elif defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n < 1 ? 1 : n > 64 ? 64 : n;
+#else
+	return 1;
+#endif
+}
+
+/*
+ * If a thread cannot be created the function is run on the calling
+ * thread instead, so callers never need a fallback path of their own.
+ */
+fz_thread *
+fz_newthread(void (*func)(void *arg), void *arg)
+{
+	fz_thread *thread = fz_malloc(sizeof(fz_thread));
+
+#if defined(NOTHREADS)
+	func(arg);
+#elif defined(_WIN32)
+	thread->func = func;
+	thread->arg = arg;
+	thread->handle = CreateThread(nil, 0, fz_threadstart, thread, 0, nil);
+	if (!thread->handle)
+		func(arg);
+#else
+	thread->func = func;
+	thread->arg = arg;
+	thread->running = pthread_create(&thread->handle, nil, fz_threadstart, thread) == 0;
+	if (!thread->running)
+		func(arg);
+#endif
+
+	return thread;
+}
+
+void
+fz_jointhread(fz_thread *thread)
+{
+#if defined(_WIN32) && !defined(NOTHREADS)
+	if (thread->handle)
+	{
+		WaitForSingleObject(thread->handle, INFINITE);
+		CloseHandle(thread->handle);
+	}
+#elif !defined(NOTHREADS)
+	if (thread->running)
+		pthread_join(thread->handle, nil);
+#endif
+	fz_free(thread);
+}
+
+fz_mutex *
+fz_newmutex(void)
+{
+	fz_mutex *mutex = fz_malloc(sizeof(fz_mutex));
+#if defined(_WIN32) && !defined(NOTHREADS)
+	InitializeCriticalSection(&mutex->cs);
+#elif !defined(NOTHREADS)
+	pthread_mutex_init(&mutex->mutex, nil);
+#endif
+	return mutex;
+}
+
+void
+fz_freemutex(fz_mutex *mutex)
+{
+	if (!mutex)
+		return;
+#if defined(_WIN32) && !defined(NOTHREADS)
+	DeleteCriticalSection(&mutex->cs);
+#elif !defined(NOTHREADS)
+	pthread_mutex_destroy(&mutex->mutex);
+#endif
+	fz_free(mutex);
+}
+
+void
+fz_lockmutex(fz_mutex *mutex)
+{
+#if defined(_WIN32) && !defined(NOTHREADS)
+	EnterCriticalSection(&mutex->cs);
+#elif !defined(NOTHREADS)
+	pthread_mutex_lock(&mutex->mutex);
+#endif
+}
+
+void
+fz_unlockmutex(fz_mutex *mutex)
+{
+#if defined(_WIN32) && !defined(NOTHREADS)
+	LeaveCriticalSection(&mutex->cs);
+#elif !defined(NOTHREADS)
+	pthread_mutex_unlock(&mutex->mutex);
+#endif
+}
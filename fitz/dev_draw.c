@@ -593,11 +593,22 @@ fz_drawfillimage(void *user, fz_pixmap *image, fz_matrix ctm, float alpha)
 
 	if (image->colorspace != model)
 	{
-		converted = fz_newpixmap(model, image->x, image->y, image->w, image->h);
+		/* packed images share their samples and convert just the lookup table */
+		if (image->lookup)
+			converted = fz_newpackedpixmap(model, image->x, image->y, image->w, image->h, image->bpc, image->samples);
+		else
+			converted = fz_newpixmap(model, image->x, image->y, image->w, image->h);
 		fz_convertpixmap(image, converted);
 		image = converted;
 	}
 
+	if (fz_paintimagebilevel(dev->dest, dev->scissor, image, ctm, nil, alpha * 255))
+	{
+		if (converted)
+			fz_droppixmap(converted);
+		return;
+	}
+
 #ifdef SMOOTHSCALE
 	dx = sqrtf(ctm.a * ctm.a + ctm.b * ctm.b);
 	dy = sqrtf(ctm.c * ctm.c + ctm.d * ctm.d);
@@ -646,6 +657,14 @@ fz_drawfillimagemask(void *user, fz_pixmap *image, fz_matrix ctm,
 	if (image->w == 0 || image->h == 0)
 		return;
 
+	fz_convertcolor(colorspace, color, model, colorfv);
+	for (i = 0; i < model->n; i++)
+		colorbv[i] = colorfv[i] * 255;
+	colorbv[i] = alpha * 255;
+
+	if (fz_paintimagebilevel(dev->dest, dev->scissor, image, ctm, colorbv, 255))
+		return;
+
 #ifdef SMOOTHSCALE
 	dx = sqrtf(ctm.a * ctm.a + ctm.b * ctm.b);
 	dy = sqrtf(ctm.c * ctm.c + ctm.d * ctm.d);
@@ -671,11 +690,6 @@ fz_drawfillimagemask(void *user, fz_pixmap *image, fz_matrix ctm,
 	}
 #endif
 
-	fz_convertcolor(colorspace, color, model, colorfv);
-	for (i = 0; i < model->n; i++)
-		colorbv[i] = colorfv[i] * 255;
-	colorbv[i] = alpha * 255;
-
 	fz_paintimagecolor(dev->dest, dev->scissor, image, ctm, colorbv);
 
 	if (scaled)
@@ -717,35 +731,38 @@ fz_drawclipimagemask(void *user, fz_pixmap *image, fz_matrix ctm)
 	fz_clearpixmap(mask);
 	fz_clearpixmap(dest);
 
-#ifdef SMOOTHSCALE
-	dx = sqrtf(ctm.a * ctm.a + ctm.b * ctm.b);
-	dy = sqrtf(ctm.c * ctm.c + ctm.d * ctm.d);
-	if (dx < image->w || dy < image->h)
+	if (!fz_paintimagebilevel(mask, bbox, image, ctm, nil, 255))
 	{
-		scaled = fz_smoothtransformpixmap(image, &ctm, dev->dest->x, dev->dest->y, dx, dy);
-		if (scaled == nil)
+#ifdef SMOOTHSCALE
+		dx = sqrtf(ctm.a * ctm.a + ctm.b * ctm.b);
+		dy = sqrtf(ctm.c * ctm.c + ctm.d * ctm.d);
+		if (dx < image->w || dy < image->h)
 		{
-			if (dx < 1)
-				dx = 1;
-			if (dy < 1)
-				dy = 1;
-			scaled = fz_smoothscalepixmap(image, image->x, image->y, dx, dy);
+			scaled = fz_smoothtransformpixmap(image, &ctm, dev->dest->x, dev->dest->y, dx, dy);
+			if (scaled == nil)
+			{
+				if (dx < 1)
+					dx = 1;
+				if (dy < 1)
+					dy = 1;
+				scaled = fz_smoothscalepixmap(image, image->x, image->y, dx, dy);
+			}
+			if (scaled != nil)
+				image = scaled;
 		}
-		if (scaled != nil)
-			image = scaled;
-	}
 #else
-	if (fz_calcimagescale(image, ctm, &dx, &dy))
-	{
-		scaled = fz_scalepixmap(image, dx, dy);
-		image = scaled;
-	}
+		if (fz_calcimagescale(image, ctm, &dx, &dy))
+		{
+			scaled = fz_scalepixmap(image, dx, dy);
+			image = scaled;
+		}
 #endif
 
-	fz_paintimage(mask, bbox, image, ctm, 255);
+		fz_paintimage(mask, bbox, image, ctm, 255);
 
-	if (scaled)
-		fz_droppixmap(scaled);
+		if (scaled)
+			fz_droppixmap(scaled);
+	}
 
 	dev->stack[dev->top].scissor = dev->scissor;
 	dev->stack[dev->top].mask = mask;
@@ -938,6 +955,7 @@ fz_newdrawdevice(fz_glyphcache *cache, fz_pixmap *dest)
 	ddev->scissor.y1 = dest->y + dest->h;
 
 	dev = fz_newdevice(ddev);
+	dev->hints = FZ_REDUCEIMAGE;
 	dev->freeuser = fz_drawfreeuser;
 
 	dev->fillpath = fz_drawfillpath;
@@ -101,3 +101,76 @@ fz_openflated(fz_stream *chain)
 
 	return fz_newstream(state, readflated, closeflated);
 }
+
+/*
+ * Inflate a whole block of compressed data in one go, straight into
+ * the output buffer. This is what reading a flate stream with
+ * fz_readall would give, with the same warnings and bomb check.
+ */
+fz_error
+fz_inflate(fz_buffer **bufp, unsigned char *data, int len, int initial)
+{
+	fz_buffer *buf;
+	z_stream z;
+	int code;
+
+	if (initial < 1024)
+		initial = 1024;
+
+	z.zalloc = zalloc;
+	z.zfree = zfree;
+	z.opaque = nil;
+	z.next_in = data;
+	z.avail_in = len;
+
+	code = inflateInit(&z);
+	if (code != Z_OK)
+		return fz_throw("zlib error: inflateInit: %s", z.msg);
+
+	buf = fz_newbuffer(initial);
+
+	while (1)
+	{
+		if (buf->len == buf->cap)
+			fz_growbuffer(buf);
+
+		if (buf->len / 200 > initial)
+		{
+			inflateEnd(&z);
+			fz_dropbuffer(buf);
+			return fz_throw("compression bomb detected");
+		}
+
+		z.next_out = buf->data + buf->len;
+		z.avail_out = buf->cap - buf->len;
+
+		code = inflate(&z, Z_SYNC_FLUSH);
+
+		buf->len = buf->cap - z.avail_out;
+
+		if (code == Z_STREAM_END)
+			break;
+		else if (code == Z_BUF_ERROR)
+		{
+			fz_warn("premature end of data in flate filter");
+			break;
+		}
+		else if (code == Z_DATA_ERROR && z.avail_in == 0)
+		{
+			fz_warn("ignoring zlib error: %s", z.msg);
+			break;
+		}
+		else if (code != Z_OK)
+		{
+			fz_error error = fz_throw("zlib error: %s", z.msg);
+			inflateEnd(&z);
+			fz_dropbuffer(buf);
+			return error;
+		}
+	}
+
+	inflateEnd(&z);
+
+	*bufp = buf;
+	return fz_okay;
+}
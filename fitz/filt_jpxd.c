@@ -18,29 +18,14 @@ static void fz_opj_info_callback(const char *msg, void *client_data)
 	/* fprintf(stderr, "openjpeg info: %s", msg); */
 }
 
-fz_error
-fz_loadjpximage(fz_pixmap **imgp, unsigned char *data, int size)
+static opj_image_t *
+fz_decodejpx(unsigned char *data, int size, int format, int reduce)
 {
-	fz_pixmap *img;
 	opj_event_mgr_t evtmgr;
 	opj_dparameters_t params;
 	opj_dinfo_t *info;
 	opj_cio_t *cio;
 	opj_image_t *jpx;
-	fz_colorspace *colorspace;
-	unsigned char *p;
-	int format;
-	int n, w, h, depth, sgnd;
-	int x, y, k, v;
-
-	if (size < 2)
-		return fz_throw("not enough data to determine image format");
-
-	/* Check for SOC marker -- if found we have a bare J2K stream */
-	if (data[0] == 0xFF && data[1] == 0x4F)
-		format = CODEC_J2K;
-	else
-		format = CODEC_JP2;
 
 	memset(&evtmgr, 0, sizeof(evtmgr));
 	evtmgr.error_handler = fz_opj_error_callback;
@@ -48,6 +33,7 @@ fz_loadjpximage(fz_pixmap **imgp, unsigned char *data, int size)
 	evtmgr.info_handler = fz_opj_info_callback;
 
 	opj_set_default_decoder_parameters(&params);
+	params.cp_reduce = reduce;
 
 	info = opj_create_decompress(format);
 	opj_set_event_mgr((opj_common_ptr)info, &evtmgr, stderr);
@@ -60,6 +46,77 @@ fz_loadjpximage(fz_pixmap **imgp, unsigned char *data, int size)
 	opj_cio_close(cio);
 	opj_destroy_decompress(info);
 
+	return jpx;
+}
+
+/*
+ * Find the smallest number of decomposition levels in the COD and COC
+ * markers of the main header. OpenJPEG does not check cp_reduce against
+ * it and silently returns an empty image if we ask for too much.
+ */
+static int
+fz_jpxlevels(unsigned char *data, int size)
+{
+	int i, len, levels = 32;
+	int ccoc = 1;
+
+	/* skip to the codestream; SOC is always followed by SIZ */
+	for (i = 0; i + 4 <= size; i++)
+		if (data[i] == 0xFF && data[i+1] == 0x4F && data[i+2] == 0xFF && data[i+3] == 0x51)
+			break;
+	i += 2;
+
+	while (i + 4 <= size && data[i] == 0xFF && data[i+1] != 0x90)
+	{
+		len = (data[i+2] << 8) | data[i+3];
+		if (i + 2 + len > size)
+			break;
+		/* SIZ: components are numbered with two bytes if there are more than 256 */
+		if (data[i+1] == 0x51 && len >= 38 && ((data[i+38] << 8) | data[i+39]) > 256)
+			ccoc = 2;
+		/* COD: Scod, progression order, layers, mct, then decomposition levels */
+		if (data[i+1] == 0x52 && len >= 12)
+			levels = MIN(levels, data[i+9]);
+		/* COC: component index, Scoc, then decomposition levels */
+		if (data[i+1] == 0x53 && len >= 5 + ccoc)
+			levels = MIN(levels, data[i+5+ccoc]);
+		i += 2 + len;
+	}
+
+	return levels == 32 ? 0 : levels;
+}
+
+/*
+ * Discarding the 'reduce' highest resolution levels halves the decoded
+ * width and height for each level and skips their wavelet synthesis.
+ * The request is clamped to the levels the codestream has, and if the
+ * reduced decode fails anyway we try again at full resolution.
+ */
+fz_error
+fz_loadjpximage(fz_pixmap **imgp, unsigned char *data, int size, int reduce)
+{
+	fz_pixmap *img;
+	opj_image_t *jpx;
+	fz_colorspace *colorspace;
+	unsigned char *p;
+	int format;
+	int n, w, h, depth, sgnd;
+	int x, y, k, v;
+
+	if (size < 2)
+		return fz_throw("not enough data to determine image format");
+
+	/* Check for SOC marker -- if found we have a bare J2K stream */
+	if (data[0] == 0xFF && data[1] == 0x4F)
+		format = CODEC_J2K;
+	else
+		format = CODEC_JP2;
+
+	reduce = MIN(reduce, fz_jpxlevels(data, size));
+
+	jpx = fz_decodejpx(data, size, format, reduce);
+	if (!jpx && reduce > 0)
+		jpx = fz_decodejpx(data, size, format, 0);
 	if (!jpx)
 		return fz_throw("opj_decode failed");
 
@@ -1,7 +1,5 @@
 #include "fitz.h"
 
-/* TODO: check if this works with 16bpp images */
-
 enum { MAXC = 32 };
 
 typedef struct fz_predict_s fz_predict;
@@ -18,7 +16,6 @@ struct fz_predict_s
 	int stride;
 	int bpp;
 	unsigned char *in;
-	unsigned char *out;
 	unsigned char *ref;
 	unsigned char *rp, *wp;
 };
@@ -32,6 +29,7 @@ getcomponent(unsigned char *buf, int x, int bpc)
 	case 2: return buf[x / 4] >> ((3 - (x % 4)) * 2) & 0x03;
 	case 4: return buf[x / 2] >> ((1 - (x % 2)) * 4) & 0x0f;
 	case 8: return buf[x];
+	case 16: return buf[x * 2] << 8 | buf[x * 2 + 1];
 	}
 	return 0;
 }
@@ -45,6 +43,7 @@ putcomponent(unsigned char *buf, int x, int bpc, int value)
 	case 2: buf[x / 4] |= value << ((3 - (x % 4)) * 2); break;
 	case 4: buf[x / 2] |= value << ((1 - (x % 2)) * 4); break;
 	case 8: buf[x] = value; break;
+	case 16: buf[x * 2] = value >> 8; buf[x * 2 + 1] = value; break;
 	}
 }
 
@@ -59,83 +58,77 @@ paeth(int a, int b, int c)
 	return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
 }
 
+/*
+ * Undo the TIFF predictor on one row in place. Rows of 8 bit
+ * components are a running sum; anything else goes through a
+ * copy of the row in tmp.
+ */
 static void
-fz_predicttiff(fz_predict *state, unsigned char *out, unsigned char *in, int len)
+fz_predicttiff(fz_predict *state, unsigned char *row, unsigned char *tmp, int len)
 {
 	int left[MAXC];
-	int i, k;
+	int i, k, n;
+
+	if (state->bpc == 8)
+	{
+		for (i = state->colors; i < len; i++)
+			row[i] += row[i - state->colors];
+		return;
+	}
 
-	for (k = 0; k < state->colors; k++)
+	memcpy(tmp, row, len);
+	memset(row, 0, len);
+
+	for (k = 0; k < state->colors && k < MAXC; k++)
 		left[k] = 0;
 
-	for (i = 0; i < state->columns; i++)
+	n = MIN(state->columns * state->colors, len * 8 / state->bpc);
+	for (i = 0; i < n; i++)
 	{
-		for (k = 0; k < state->colors; k++)
+		k = i % state->colors;
+		if (k < MAXC)
 		{
-			int a = getcomponent(in, i * state->colors + k, state->bpc);
+			int a = getcomponent(tmp, i, state->bpc);
 			int b = a + left[k];
 			int c = b % (1 << state->bpc);
-			putcomponent(out, i * state->colors + k, state->bpc, c);
+			putcomponent(row, i, state->bpc, c);
 			left[k] = c;
 		}
 	}
 }
 
+/*
+ * Undo a PNG filter on one row in place, given the previous row
+ * already decoded in ref. The loops carry no state but the row
+ * pointers so that the compiler can vectorise them; Sub, Average
+ * and Paeth depend on the pixel to the left and only Up runs wide.
+ */
 static void
-fz_predictpng(fz_predict *state, unsigned char *out, unsigned char *in, int len, int predictor)
+fz_predictpng(unsigned char *row, unsigned char *ref, int len, int bpp, int predictor)
 {
-	int bpp = state->bpp;
 	int i;
-	unsigned char *ref = state->ref;
 
 	switch (predictor)
 	{
-	case 0:
-		memcpy(out, in, len);
-		break;
 	case 1:
-		for (i = bpp; i > 0; i--)
-		{
-			*out++ = *in++;
-		}
-		for (i = len - bpp; i > 0; i--)
-		{
-			*out = *in++ + out[-bpp];
-			out++;
-		}
+		for (i = bpp; i < len; i++)
+			row[i] += row[i - bpp];
 		break;
 	case 2:
-		for (i = bpp; i > 0; i--)
-		{
-			*out++ = *in++ + *ref++;
-		}
-		for (i = len - bpp; i > 0; i--)
-		{
-			*out++ = *in++ + *ref++;
-		}
+		for (i = 0; i < len; i++)
+			row[i] += ref[i];
 		break;
 	case 3:
-		for (i = bpp; i > 0; i--)
-		{
-			*out++ = *in++ + (*ref++) / 2;
-		}
-		for (i = len - bpp; i > 0; i--)
-		{
-			*out = *in++ + (out[-bpp] + *ref++) / 2;
-			out++;
-		}
+		for (i = 0; i < bpp && i < len; i++)
+			row[i] += ref[i] >> 1;
+		for (; i < len; i++)
+			row[i] += (row[i - bpp] + ref[i]) >> 1;
 		break;
 	case 4:
-		for (i = bpp; i > 0; i--)
-		{
-			*out++ = *in++ + paeth(0, *ref++, 0);
-		}
-		for (i = len - bpp; i > 0; i --)
-		{
-			*out = *in++ + paeth(out[-bpp], *ref, ref[-bpp]);
-			ref++;
-			out++;
-		}
+		for (i = 0; i < bpp && i < len; i++)
+			row[i] += ref[i];
+		for (; i < len; i++)
+			row[i] += paeth(row[i - bpp], ref[i], ref[i - bpp]);
 		break;
 	}
 }
@@ -146,6 +139,7 @@ readpredict(fz_stream *stm, unsigned char *buf, int len)
 	fz_predict *state = stm->state;
 	unsigned char *p = buf;
 	unsigned char *ep = buf + len;
+	unsigned char *tmp;
 	int ispng = state->predictor >= 10;
 	int n;
 
@@ -160,19 +154,22 @@ readpredict(fz_stream *stm, unsigned char *buf, int len)
 		if (n == 0)
 			return p - buf;
 
-		if (state->predictor == 1)
-			memcpy(state->out, state->in, n);
-		else if (state->predictor == 2)
-			fz_predicttiff(state, state->out, state->in, n);
-		else
+		if (state->predictor == 2)
+			fz_predicttiff(state, state->in, state->ref, n);
+		else if (ispng)
+			fz_predictpng(state->in + 1, state->ref + 1, n - 1, state->bpp, state->in[0]);
+
+		state->rp = state->in + ispng;
+		state->wp = state->in + n;
+
+		/* the decoded row is the reference for the next one */
+		if (ispng)
 		{
-			fz_predictpng(state, state->out, state->in + 1, n - 1, state->in[0]);
-			memcpy(state->ref, state->out, state->stride);
+			tmp = state->ref;
+			state->ref = state->in;
+			state->in = tmp;
 		}
 
-		state->rp = state->out;
-		state->wp = state->out + n - ispng;
-
 		while (state->rp < state->wp && p < ep)
 			*p++ = *state->rp++;
 	}
@@ -186,20 +183,15 @@ closepredict(fz_stream *stm)
 	fz_predict *state = stm->state;
 	fz_close(state->chain);
 	fz_free(state->in);
-	fz_free(state->out);
 	fz_free(state->ref);
 	fz_free(state);
 }
 
-fz_stream *
-fz_openpredict(fz_stream *chain, fz_obj *params)
+static void
+fz_loadpredictparams(fz_predict *state, fz_obj *params)
 {
-	fz_predict *state;
 	fz_obj *obj;
 
-	state = fz_malloc(sizeof(fz_predict));
-	state->chain = chain;
-
 	state->predictor = 1;
 	state->columns = 1;
 	state->colors = 1;
@@ -232,14 +224,75 @@ fz_openpredict(fz_stream *chain, fz_obj *params)
 
 	state->stride = (state->bpc * state->colors * state->columns + 7) / 8;
 	state->bpp = (state->bpc * state->colors + 7) / 8;
+}
+
+fz_stream *
+fz_openpredict(fz_stream *chain, fz_obj *params)
+{
+	fz_predict *state;
 
+	state = fz_malloc(sizeof(fz_predict));
+	state->chain = chain;
+
+	fz_loadpredictparams(state, params);
+
+	/* both buffers hold a filter byte so they can be swapped */
 	state->in = fz_malloc(state->stride + 1);
-	state->out = fz_malloc(state->stride);
-	state->ref = fz_malloc(state->stride);
-	state->rp = state->out;
-	state->wp = state->out;
+	state->ref = fz_malloc(state->stride + 1);
+	state->rp = state->in;
+	state->wp = state->in;
 
-	memset(state->ref, 0, state->stride);
+	memset(state->ref, 0, state->stride + 1);
 
 	return fz_newstream(state, readpredict, closepredict);
 }
+
+/*
+ * Undo a predictor in place on a whole buffer of decoded data,
+ * as reading it through fz_openpredict would.
+ * The PNG filter bytes are squeezed out, so the buffer shrinks.
+ */
+void
+fz_predictbuffer(fz_buffer *buf, fz_obj *params)
+{
+	fz_predict state;
+	unsigned char *tmp;
+	unsigned char *ref;
+	unsigned char *in, *out, *end;
+	int n;
+
+	fz_loadpredictparams(&state, params);
+
+	if (state.predictor == 1 || state.stride <= 0)
+		return;
+
+	tmp = fz_calloc(state.stride + 1, 1);
+	memset(tmp, 0, state.stride + 1);
+	end = buf->data + buf->len;
+
+	if (state.predictor == 2)
+	{
+		for (in = buf->data; in < end; in += state.stride)
+			fz_predicttiff(&state, in, tmp, MIN(state.stride, end - in));
+		fz_free(tmp);
+		return;
+	}
+
+	/*
+	 * Each row is decoded where it lies, against the row before it
+	 * that has already been moved down into place.
+	 */
+	ref = tmp;
+	out = buf->data;
+	for (in = buf->data; in < end; in += state.stride + 1)
+	{
+		n = MIN(state.stride, end - in - 1);
+		fz_predictpng(in + 1, ref, n, state.bpp, in[0]);
+		memmove(out, in + 1, n);
+		ref = out;
+		out += n;
+	}
+	buf->len = out - buf->data;
+
+	fz_free(tmp);
+}
@@ -1,6 +1,11 @@
 #ifndef _FITZ_H_
 #define _FITZ_H_
 
+/* ask for 64-bit off_t and lseek on 32-bit unix */
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
 /*
  * Include the standard libc headers.
  */
@@ -38,6 +43,8 @@ int gettimeofday(struct timeval *tv, struct timezone *tz);
 
 #define snprintf _snprintf
 #define strtoll _strtoi64
+#define lseek _lseeki64
+#define ftello _ftelli64
 
 #else /* Unix or close enough */
 
@@ -49,6 +56,9 @@ int gettimeofday(struct timeval *tv, struct timezone *tz);
 
 #endif
 
+/* file offsets and positions; 64-bit so we can read files over 2 GB */
+typedef long long fz_off_t;
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
@@ -163,6 +173,23 @@ extern int fz_getopt(int nargc, char * const *nargv, const char *ostr);
 extern int fz_optind;
 extern char *fz_optarg;
 
+/*
+ * Threads and mutexes. With NOTHREADS defined a new thread runs
+ * to completion on the caller and mutexes do nothing.
+ */
+
+typedef struct fz_thread_s fz_thread;
+typedef struct fz_mutex_s fz_mutex;
+
+int fz_cpucount(void);
+fz_thread *fz_newthread(void (*func)(void *arg), void *arg);
+void fz_jointhread(fz_thread *thread);
+
+fz_mutex *fz_newmutex(void);
+void fz_freemutex(fz_mutex *mutex);
+void fz_lockmutex(fz_mutex *mutex);
+void fz_unlockmutex(fz_mutex *mutex);
+
 /*
  * Generic hash-table with fixed-length keys.
  */
@@ -379,8 +406,7 @@ struct fz_obj_s
 	fz_objkind kind;
 	union
 	{
-		int b;
-		int i;
+		fz_off_t i; /* first, so that static ints can be initialised */
 		float f;
 		struct {
 			unsigned short len;
@@ -406,9 +432,43 @@ struct fz_obj_s
 	} u;
 };
 
+/*
+ * The standard names are interned: there is one static object for
+ * each, which fz_newname hands out instead of making a copy, and
+ * which is never freed. Dictionary lookups with FZ_NAME(Type) and
+ * the like compare pointers instead of strings.
+ */
+
+typedef struct fz_stdname_s fz_stdname;
+
+struct fz_stdname_s
+{
+	int refs;
+	fz_objkind kind;
+	union
+	{
+		char n[24];
+		fz_off_t i;
+		void *p;
+	} u;
+};
+
+enum
+{
+#define FZ_STDNAME(x) FZ_NAME_##x,
+#include "obj_namelist.h"
+#undef FZ_STDNAME
+	FZ_NAME_COUNT
+};
+
+extern fz_stdname fz_stdnames[];
+
+#define FZ_NAME(x) ((fz_obj*)&fz_stdnames[FZ_NAME_##x])
+
 fz_obj *fz_newnull(void);
 fz_obj *fz_newbool(int b);
 fz_obj *fz_newint(int i);
+fz_obj *fz_newoffset(fz_off_t i);
 fz_obj *fz_newreal(float f);
 fz_obj *fz_newname(char *str);
 fz_obj *fz_newstring(char *str, int len);
@@ -434,12 +494,14 @@ int fz_isdict(fz_obj *obj);
 int fz_isindirect(fz_obj *obj);
 
 int fz_objcmp(fz_obj *a, fz_obj *b);
+unsigned fz_objhash(fz_obj *obj);
 
 fz_obj *fz_resolveindirect(fz_obj *obj);
 
 /* silent failure, no error reporting */
 int fz_tobool(fz_obj *obj);
 int fz_toint(fz_obj *obj);
+fz_off_t fz_tooffset(fz_obj *obj);
 float fz_toreal(fz_obj *obj);
 char *fz_toname(fz_obj *obj);
 char *fz_tostrbuf(fz_obj *obj);
@@ -483,9 +545,13 @@ struct fz_buffer_s
 	int refs;
 	unsigned char *data;
 	int cap, len;
+	int mapped; /* data is a private file mapping */
+	fz_buffer *base; /* data points into this buffer */
 };
 
 fz_buffer *fz_newbuffer(int size);
+fz_buffer *fz_newbufferview(fz_buffer *base, int offset, int len);
+fz_buffer *fz_mapfile(int fd);
 fz_buffer *fz_keepbuffer(fz_buffer *buf);
 void fz_dropbuffer(fz_buffer *buf);
 
@@ -504,27 +570,28 @@ struct fz_stream_s
 	int refs;
 	int error;
 	int eof;
-	int pos;
+	fz_off_t pos;
 	int avail;
 	int bits;
 	unsigned char *bp, *rp, *wp, *ep;
 	void *state;
 	int (*read)(fz_stream *stm, unsigned char *buf, int len);
 	void (*close)(fz_stream *stm);
-	void (*seek)(fz_stream *stm, int offset, int whence);
+	void (*seek)(fz_stream *stm, fz_off_t offset, int whence);
 	unsigned char buf[4096];
 };
 
 fz_stream *fz_openfile(int file);
 fz_stream *fz_openbuffer(fz_buffer *buf);
+fz_buffer *fz_streambuffer(fz_stream *stm);
 void fz_close(fz_stream *stm);
 
 fz_stream *fz_newstream(void*, int(*)(fz_stream*, unsigned char*, int), void(*)(fz_stream *));
 fz_stream *fz_keepstream(fz_stream *stm);
 void fz_fillbuffer(fz_stream *stm);
 
-int fz_tell(fz_stream *stm);
-void fz_seek(fz_stream *stm, int offset, int whence);
+fz_off_t fz_tell(fz_stream *stm);
+void fz_seek(fz_stream *stm, fz_off_t offset, int whence);
 
 int fz_read(fz_stream *stm, unsigned char *buf, int len);
 void fz_readline(fz_stream *stm, char *buf, int max);
@@ -609,6 +676,43 @@ static inline int fz_iseofbits(fz_stream *stm)
 	return fz_iseof(stm) && (stm->avail == 0 || stm->bits == EOF);
 }
 
+/*
+ * Random access byte sources.
+ * Every stream opened on a source has its own position.
+ *
+ * A source for some other storage than a file is made with fz_newsource,
+ * given its total length and a readat function that reads up to len
+ * bytes at ofs and returns how many it read, or an error. readat may be
+ * called from more than one thread. The optional prefetch function is
+ * told about ranges that will be read soon, so that it can start to
+ * fetch them; it must not block.
+ */
+
+typedef struct fz_source_s fz_source;
+
+struct fz_source_s
+{
+	int refs;
+	fz_off_t len;
+	fz_buffer *buf; /* the whole source, if it is in memory */
+	void *state;
+	int (*readat)(fz_source *src, fz_off_t ofs, unsigned char *buf, int len);
+	void (*prefetch)(fz_source *src, fz_off_t ofs, fz_off_t len);
+	void (*close)(fz_source *src);
+};
+
+fz_source *fz_newsource(void *state, fz_off_t len,
+	int (*readat)(fz_source *src, fz_off_t ofs, unsigned char *buf, int len),
+	void (*close)(fz_source *src));
+fz_source *fz_newfilesource(int fd);
+fz_source *fz_newbuffersource(fz_buffer *buf);
+fz_source *fz_keepsource(fz_source *src);
+void fz_dropsource(fz_source *src);
+void fz_prefetchsource(fz_source *src, fz_off_t ofs, fz_off_t len);
+
+fz_stream *fz_opensource(fz_source *src);
+fz_source *fz_streamsource(fz_stream *stm);
+
 /*
  * Data filters.
  */
@@ -627,6 +731,9 @@ fz_stream *fz_openlzwd(fz_stream *chain, fz_obj *param);
 fz_stream *fz_openpredict(fz_stream *chain, fz_obj *param);
 fz_stream *fz_openjbig2d(fz_stream *chain, fz_buffer *global);
 
+fz_error fz_inflate(fz_buffer **bufp, unsigned char *data, int len, int initial);
+void fz_predictbuffer(fz_buffer *buf, fz_obj *param);
+
 /*
  * Resources and other graphics related objects.
  */
@@ -676,17 +783,23 @@ struct fz_pixmap_s
 	fz_colorspace *colorspace;
 	unsigned char *samples;
 	int freesamples;
+	/* packed images: each pixel is a bpc bit index into lookup */
+	int bpc;
+	unsigned char *lookup;
 };
 
 fz_pixmap *fz_newpixmapwithdata(fz_colorspace *colorspace, int x, int y, int w, int h, unsigned char *samples);
 fz_pixmap *fz_newpixmapwithrect(fz_colorspace *, fz_bbox bbox);
 fz_pixmap *fz_newpixmap(fz_colorspace *, int x, int y, int w, int h);
+fz_pixmap *fz_newpackedpixmap(fz_colorspace *, int x, int y, int w, int h, int bpc, unsigned char *samples);
 fz_pixmap *fz_keeppixmap(fz_pixmap *pix);
 void fz_droppixmap(fz_pixmap *pix);
 void fz_clearpixmap(fz_pixmap *pix);
 void fz_clearpixmapwithcolor(fz_pixmap *pix, int value);
 fz_pixmap *fz_alphafromgray(fz_pixmap *gray, int luminosity);
 fz_bbox fz_boundpixmap(fz_pixmap *pix);
+void fz_unpackpixmaprow(fz_pixmap *pix, int y, unsigned char *dst);
+fz_pixmap *fz_unpackpixmap(fz_pixmap *pix);
 
 fz_pixmap *fz_scalepixmap(fz_pixmap *src, int xdenom, int ydenom);
 fz_pixmap *fz_smoothscalepixmap(fz_pixmap *src, float x, float y, float w, float h);
@@ -695,7 +808,7 @@ fz_error fz_writepnm(fz_pixmap *pixmap, char *filename);
 fz_error fz_writepam(fz_pixmap *pixmap, char *filename, int savealpha);
 fz_error fz_writepng(fz_pixmap *pixmap, char *filename, int savealpha);
 
-fz_error fz_loadjpximage(fz_pixmap **imgp, unsigned char *data, int size);
+fz_error fz_loadjpximage(fz_pixmap **imgp, unsigned char *data, int size, int reduce);
 
 /*
  * Colorspace resources.
@@ -746,8 +859,7 @@ struct fz_font_s
 
 	/* origin of font data */
 	char *ftfile;
-	unsigned char *ftdata;
-	int ftsize;
+	fz_buffer *ftbuf;
 
 	fz_matrix t3matrix;
 	fz_obj *t3resources;
@@ -986,6 +1098,7 @@ enum
 {
 	FZ_IGNOREIMAGE = 1,
 	FZ_IGNORESHADE = 2,
+	FZ_REDUCEIMAGE = 4, /* ctm is device space; images may be loaded at the size drawn */
 };
 
 typedef struct fz_device_s fz_device;
@@ -1184,6 +1297,7 @@ void fz_paintaffinecolor(unsigned char *dp, unsigned char *sp, int sw, int sh, i
 
 void fz_paintimage(fz_pixmap *dst, fz_bbox scissor, fz_pixmap *img, fz_matrix ctm, int alpha);
 void fz_paintimagecolor(fz_pixmap *dst, fz_bbox scissor, fz_pixmap *img, fz_matrix ctm, unsigned char *colorbv);
+int fz_paintimagebilevel(fz_pixmap *dst, fz_bbox scissor, fz_pixmap *img, fz_matrix ctm, unsigned char *colorbv, int alpha);
 
 void fz_paintpixmap(fz_pixmap *dst, fz_pixmap *src, int alpha);
 void fz_paintpixmapmask(fz_pixmap *dst, fz_pixmap *src, fz_pixmap *msk);
@@ -126,6 +126,25 @@ fz_dictfinds(fz_obj *obj, char *key)
 	return -1;
 }
 
+/*
+ * There is only one object for each standard name, so
+ * those are found by their address unless the dict is big.
+ */
+static inline int
+fz_dictfind(fz_obj *obj, fz_obj *key)
+{
+	int i;
+
+	if (key->refs >= 0 || (obj->u.d.sorted && obj->u.d.len > 32))
+		return fz_dictfinds(obj, fz_toname(key));
+
+	for (i = 0; i < obj->u.d.len; i++)
+		if (obj->u.d.items[i].k == key)
+			return i;
+
+	return -1;
+}
+
 fz_obj *
 fz_dictgets(fz_obj *obj, char *key)
 {
@@ -146,8 +165,17 @@ fz_dictgets(fz_obj *obj, char *key)
 fz_obj *
 fz_dictget(fz_obj *obj, fz_obj *key)
 {
-	if (fz_isname(key))
-		return fz_dictgets(obj, fz_toname(key));
+	int i;
+
+	obj = fz_resolveindirect(obj);
+
+	if (!fz_isdict(obj) || !fz_isname(key))
+		return nil;
+
+	i = fz_dictfind(obj, key);
+	if (i >= 0)
+		return obj->u.d.items[i].v;
+
 	return nil;
 }
 
@@ -189,7 +217,7 @@ fz_dictput(fz_obj *obj, fz_obj *key, fz_obj *val)
 		return;
 	}
 
-	i = fz_dictfinds(obj, s);
+	i = fz_dictfind(obj, key);
 	if (i >= 0)
 	{
 		fz_dropobj(obj->u.d.items[i].v);
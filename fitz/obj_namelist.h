@@ -0,0 +1,265 @@
+/*
+ * The standard names that have one shared object each.
+ * Keep the list sorted by strcmp, fz_newname searches it.
+ */
+
+FZ_STDNAME(A)
+FZ_STDNAME(A85)
+FZ_STDNAME(AESV2)
+FZ_STDNAME(AESV3)
+FZ_STDNAME(AHx)
+FZ_STDNAME(AP)
+FZ_STDNAME(AS)
+FZ_STDNAME(ASCII85Decode)
+FZ_STDNAME(ASCIIHexDecode)
+FZ_STDNAME(AcroForm)
+FZ_STDNAME(Annot)
+FZ_STDNAME(Annots)
+FZ_STDNAME(ArtBox)
+FZ_STDNAME(Ascent)
+FZ_STDNAME(Author)
+FZ_STDNAME(AvgWidth)
+FZ_STDNAME(BBox)
+FZ_STDNAME(BC)
+FZ_STDNAME(BM)
+FZ_STDNAME(BPC)
+FZ_STDNAME(Background)
+FZ_STDNAME(BaseEncoding)
+FZ_STDNAME(BaseFont)
+FZ_STDNAME(BitsPerComponent)
+FZ_STDNAME(BitsPerCoordinate)
+FZ_STDNAME(BitsPerFlag)
+FZ_STDNAME(BitsPerSample)
+FZ_STDNAME(BlackIs1)
+FZ_STDNAME(BleedBox)
+FZ_STDNAME(Border)
+FZ_STDNAME(Bounds)
+FZ_STDNAME(C0)
+FZ_STDNAME(C1)
+FZ_STDNAME(CA)
+FZ_STDNAME(CCF)
+FZ_STDNAME(CCITTFaxDecode)
+FZ_STDNAME(CF)
+FZ_STDNAME(CFM)
+FZ_STDNAME(CIDFontType0)
+FZ_STDNAME(CIDFontType2)
+FZ_STDNAME(CIDSystemInfo)
+FZ_STDNAME(CIDToGIDMap)
+FZ_STDNAME(CMYK)
+FZ_STDNAME(CS)
+FZ_STDNAME(CalCMYK)
+FZ_STDNAME(CalGray)
+FZ_STDNAME(CalRGB)
+FZ_STDNAME(CapHeight)
+FZ_STDNAME(Catalog)
+FZ_STDNAME(CharProcs)
+FZ_STDNAME(ColorSpace)
+FZ_STDNAME(ColorTransform)
+FZ_STDNAME(Colors)
+FZ_STDNAME(Columns)
+FZ_STDNAME(Contents)
+FZ_STDNAME(Coords)
+FZ_STDNAME(Count)
+FZ_STDNAME(CreationDate)
+FZ_STDNAME(Creator)
+FZ_STDNAME(CropBox)
+FZ_STDNAME(Crypt)
+FZ_STDNAME(D)
+FZ_STDNAME(DA)
+FZ_STDNAME(DCT)
+FZ_STDNAME(DCTDecode)
+FZ_STDNAME(DP)
+FZ_STDNAME(DR)
+FZ_STDNAME(DW)
+FZ_STDNAME(DW2)
+FZ_STDNAME(Decode)
+FZ_STDNAME(DecodeParms)
+FZ_STDNAME(DescendantFonts)
+FZ_STDNAME(Descent)
+FZ_STDNAME(Dest)
+FZ_STDNAME(Dests)
+FZ_STDNAME(DeviceCMYK)
+FZ_STDNAME(DeviceGray)
+FZ_STDNAME(DeviceN)
+FZ_STDNAME(DeviceRGB)
+FZ_STDNAME(Differences)
+FZ_STDNAME(Domain)
+FZ_STDNAME(E)
+FZ_STDNAME(EarlyChange)
+FZ_STDNAME(Encode)
+FZ_STDNAME(EncodedByteAlign)
+FZ_STDNAME(Encoding)
+FZ_STDNAME(Encrypt)
+FZ_STDNAME(EncryptMetadata)
+FZ_STDNAME(EndOfBlock)
+FZ_STDNAME(EndOfLine)
+FZ_STDNAME(ExtGState)
+FZ_STDNAME(Extend)
+FZ_STDNAME(F)
+FZ_STDNAME(FT)
+FZ_STDNAME(Fields)
+FZ_STDNAME(Filter)
+FZ_STDNAME(First)
+FZ_STDNAME(FirstChar)
+FZ_STDNAME(Fit)
+FZ_STDNAME(FitB)
+FZ_STDNAME(FitBH)
+FZ_STDNAME(FitBV)
+FZ_STDNAME(FitH)
+FZ_STDNAME(FitR)
+FZ_STDNAME(FitV)
+FZ_STDNAME(Fl)
+FZ_STDNAME(Flags)
+FZ_STDNAME(FlateDecode)
+FZ_STDNAME(Font)
+FZ_STDNAME(FontBBox)
+FZ_STDNAME(FontDescriptor)
+FZ_STDNAME(FontFamily)
+FZ_STDNAME(FontFile)
+FZ_STDNAME(FontFile2)
+FZ_STDNAME(FontFile3)
+FZ_STDNAME(FontMatrix)
+FZ_STDNAME(FontName)
+FZ_STDNAME(FontStretch)
+FZ_STDNAME(FontWeight)
+FZ_STDNAME(Form)
+FZ_STDNAME(Function)
+FZ_STDNAME(FunctionType)
+FZ_STDNAME(Functions)
+FZ_STDNAME(G)
+FZ_STDNAME(GoTo)
+FZ_STDNAME(GoToR)
+FZ_STDNAME(Group)
+FZ_STDNAME(H)
+FZ_STDNAME(Height)
+FZ_STDNAME(I)
+FZ_STDNAME(ICCBased)
+FZ_STDNAME(ID)
+FZ_STDNAME(IM)
+FZ_STDNAME(Identity)
+FZ_STDNAME(Image)
+FZ_STDNAME(ImageMask)
+FZ_STDNAME(Index)
+FZ_STDNAME(Indexed)
+FZ_STDNAME(Info)
+FZ_STDNAME(Interpolate)
+FZ_STDNAME(ItalicAngle)
+FZ_STDNAME(JBIG2Decode)
+FZ_STDNAME(JBIG2Globals)
+FZ_STDNAME(JPXDecode)
+FZ_STDNAME(K)
+FZ_STDNAME(Keywords)
+FZ_STDNAME(Kids)
+FZ_STDNAME(L)
+FZ_STDNAME(LZW)
+FZ_STDNAME(LZWDecode)
+FZ_STDNAME(Lab)
+FZ_STDNAME(Lang)
+FZ_STDNAME(LastChar)
+FZ_STDNAME(Launch)
+FZ_STDNAME(Leading)
+FZ_STDNAME(Length)
+FZ_STDNAME(Limits)
+FZ_STDNAME(Linearized)
+FZ_STDNAME(Link)
+FZ_STDNAME(Luminosity)
+FZ_STDNAME(MarkInfo)
+FZ_STDNAME(Mask)
+FZ_STDNAME(Matrix)
+FZ_STDNAME(MaxWidth)
+FZ_STDNAME(MediaBox)
+FZ_STDNAME(Metadata)
+FZ_STDNAME(MissingWidth)
+FZ_STDNAME(ModDate)
+FZ_STDNAME(N)
+FZ_STDNAME(Name)
+FZ_STDNAME(Named)
+FZ_STDNAME(Names)
+FZ_STDNAME(Next)
+FZ_STDNAME(None)
+FZ_STDNAME(Normal)
+FZ_STDNAME(O)
+FZ_STDNAME(OE)
+FZ_STDNAME(ObjStm)
+FZ_STDNAME(OpenAction)
+FZ_STDNAME(Ordering)
+FZ_STDNAME(Outlines)
+FZ_STDNAME(P)
+FZ_STDNAME(PS)
+FZ_STDNAME(Page)
+FZ_STDNAME(PageLabels)
+FZ_STDNAME(PageLayout)
+FZ_STDNAME(PageMode)
+FZ_STDNAME(Pages)
+FZ_STDNAME(PaintType)
+FZ_STDNAME(Parent)
+FZ_STDNAME(Pattern)
+FZ_STDNAME(PatternType)
+FZ_STDNAME(Predictor)
+FZ_STDNAME(Prev)
+FZ_STDNAME(ProcSet)
+FZ_STDNAME(Producer)
+FZ_STDNAME(R)
+FZ_STDNAME(RGB)
+FZ_STDNAME(RL)
+FZ_STDNAME(Range)
+FZ_STDNAME(Rect)
+FZ_STDNAME(Ref)
+FZ_STDNAME(Registry)
+FZ_STDNAME(Resources)
+FZ_STDNAME(Root)
+FZ_STDNAME(Rotate)
+FZ_STDNAME(Rows)
+FZ_STDNAME(RunLengthDecode)
+FZ_STDNAME(S)
+FZ_STDNAME(SMask)
+FZ_STDNAME(Separation)
+FZ_STDNAME(Shading)
+FZ_STDNAME(ShadingType)
+FZ_STDNAME(Size)
+FZ_STDNAME(Standard)
+FZ_STDNAME(StemH)
+FZ_STDNAME(StemV)
+FZ_STDNAME(StmF)
+FZ_STDNAME(StrF)
+FZ_STDNAME(StructParents)
+FZ_STDNAME(StructTreeRoot)
+FZ_STDNAME(Subject)
+FZ_STDNAME(Subtype)
+FZ_STDNAME(Subtype2)
+FZ_STDNAME(T)
+FZ_STDNAME(Tabs)
+FZ_STDNAME(Text)
+FZ_STDNAME(TilingType)
+FZ_STDNAME(Title)
+FZ_STDNAME(ToUnicode)
+FZ_STDNAME(Transparency)
+FZ_STDNAME(TrimBox)
+FZ_STDNAME(TrueType)
+FZ_STDNAME(Type)
+FZ_STDNAME(Type0)
+FZ_STDNAME(Type1)
+FZ_STDNAME(Type3)
+FZ_STDNAME(U)
+FZ_STDNAME(UE)
+FZ_STDNAME(URI)
+FZ_STDNAME(UseCMap)
+FZ_STDNAME(V)
+FZ_STDNAME(V2)
+FZ_STDNAME(Version)
+FZ_STDNAME(VerticesPerRow)
+FZ_STDNAME(ViewerPreferences)
+FZ_STDNAME(W)
+FZ_STDNAME(W2)
+FZ_STDNAME(WMode)
+FZ_STDNAME(Widget)
+FZ_STDNAME(Width)
+FZ_STDNAME(Widths)
+FZ_STDNAME(XHeight)
+FZ_STDNAME(XObject)
+FZ_STDNAME(XRef)
+FZ_STDNAME(XRefStm)
+FZ_STDNAME(XStep)
+FZ_STDNAME(XYZ)
+FZ_STDNAME(YStep)
+FZ_STDNAME(ca)
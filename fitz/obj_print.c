@@ -98,10 +98,12 @@ static void fmtstr(struct fmt *fmt, fz_obj *obj)
 			fmtputs(fmt, "\\(");
 		else if (c == ')')
 			fmtputs(fmt, "\\)");
+		else if (c == '\\')
+			fmtputs(fmt, "\\\\");
 		else if (c < 32 || c > 126) {
 			char buf[16];
 			fmtputc(fmt, '\\');
-			sprintf(buf, "%o", c);
+			sprintf(buf, "%03o", c);
 			fmtputs(fmt, buf);
 		}
 		else
@@ -231,7 +233,7 @@ static void fmtobj(struct fmt *fmt, fz_obj *obj)
 		fmtputs(fmt, fz_tobool(obj) ? "true" : "false");
 	else if (fz_isint(obj))
 	{
-		sprintf(buf, "%d", fz_toint(obj));
+		sprintf(buf, "%lld", fz_tooffset(obj));
 		fmtputs(fmt, buf);
 	}
 	else if (fz_isreal(obj))
@@ -251,10 +253,8 @@ static void fmtobj(struct fmt *fmt, fz_obj *obj)
 			c = (unsigned char)str[i];
 			if (strchr("()\\\n\r\t\b\f", c))
 				added ++;
-			else if (c < 8)
-				added ++;
 			else if (c < 32)
-				added += 2;
+				added += 3;
 			else if (c >= 127)
 				added += 3;
 		}
@@ -4,29 +4,57 @@
 extern void fz_freearray(fz_obj *array);
 extern void fz_freedict(fz_obj *dict);
 
+/*
+ * Null, the booleans and the small integers that make up most
+ * of the numbers in a file (widths, counts, generations, flags)
+ * are static objects that are shared and never freed, like the
+ * standard names. Like them they have a negative reference count.
+ */
+
+enum { MINSMALLINT = -256, MAXSMALLINT = 1023 };
+
+#define INT1(n) { -1, FZ_INT, { (n) } }
+#define INT4(n) INT1(n), INT1(n+1), INT1(n+2), INT1(n+3)
+#define INT16(n) INT4(n), INT4(n+4), INT4(n+8), INT4(n+12)
+#define INT64(n) INT16(n), INT16(n+16), INT16(n+32), INT16(n+48)
+#define INT256(n) INT64(n), INT64(n+64), INT64(n+128), INT64(n+192)
+
+static fz_obj ksmallints[MAXSMALLINT - MINSMALLINT + 1] =
+{
+	INT256(-256), INT256(0), INT256(256), INT256(512), INT256(768)
+};
+
+static fz_obj knull = { -1, FZ_NULL, { 0 } };
+static fz_obj kfalse = { -1, FZ_BOOL, { 0 } };
+static fz_obj ktrue = { -1, FZ_BOOL, { 1 } };
+
 fz_obj *
 fz_newnull(void)
 {
-	fz_obj *o = fz_malloc(sizeof(fz_obj));
-	o->refs = 1;
-	o->kind = FZ_NULL;
-	return o;
+	return &knull;
 }
 
 fz_obj *
 fz_newbool(int b)
 {
-	fz_obj *o = fz_malloc(sizeof(fz_obj));
-	o->refs = 1;
-	o->kind = FZ_BOOL;
-	o->u.b = b;
-	return o;
+	return b ? &ktrue : &kfalse;
 }
 
 fz_obj *
 fz_newint(int i)
 {
-	fz_obj *o = fz_malloc(sizeof(fz_obj));
+	return fz_newoffset(i);
+}
+
+fz_obj *
+fz_newoffset(fz_off_t i)
+{
+	fz_obj *o;
+
+	if (i >= MINSMALLINT && i <= MAXSMALLINT)
+		return &ksmallints[i - MINSMALLINT];
+
+	o = fz_malloc(sizeof(fz_obj));
 	o->refs = 1;
 	o->kind = FZ_INT;
 	o->u.i = i;
@@ -55,10 +83,43 @@ fz_newstring(char *str, int len)
 	return o;
 }
 
+fz_stdname fz_stdnames[] =
+{
+#define FZ_STDNAME(x) { -1, FZ_NAME, { #x } },
+#include "obj_namelist.h"
+#undef FZ_STDNAME
+};
+
+/* the static names must look like any other name object */
+typedef char fz_checkstdname[offsetof(fz_stdname, u.n) == offsetof(fz_obj, u.n) ? 1 : -1];
+
+static fz_obj *
+fz_findstdname(char *str)
+{
+	int l = 0;
+	int r = FZ_NAME_COUNT - 1;
+	while (l <= r)
+	{
+		int m = (l + r) >> 1;
+		int c = strcmp(str, fz_stdnames[m].u.n);
+		if (c < 0)
+			r = m - 1;
+		else if (c > 0)
+			l = m + 1;
+		else
+			return (fz_obj*)&fz_stdnames[m];
+	}
+	return nil;
+}
+
 fz_obj *
 fz_newname(char *str)
 {
-	fz_obj *o = fz_malloc(offsetof(fz_obj, u.n) + strlen(str) + 1);
+	fz_obj *o = fz_findstdname(str);
+	if (o)
+		return o;
+
+	o = fz_malloc(offsetof(fz_obj, u.n) + strlen(str) + 1);
 	o->refs = 1;
 	o->kind = FZ_NAME;
 	strcpy(o->u.n, str);
@@ -81,6 +142,8 @@ fz_obj *
 fz_keepobj(fz_obj *o)
 {
 	assert(o != nil);
+	if (o->refs < 0)
+		return o;
 	o->refs ++;
 	return o;
 }
@@ -89,6 +152,8 @@ void
 fz_dropobj(fz_obj *o)
 {
 	assert(o != nil);
+	if (o->refs < 0)
+		return;
 	if (--o->refs == 0)
 	{
 		if (o->kind == FZ_ARRAY)
@@ -157,11 +222,21 @@ int fz_tobool(fz_obj *obj)
 {
 	obj = fz_resolveindirect(obj);
 	if (fz_isbool(obj))
-		return obj->u.b;
+		return obj->u.i != 0;
 	return 0;
 }
 
 int fz_toint(fz_obj *obj)
+{
+	obj = fz_resolveindirect(obj);
+	if (fz_isint(obj))
+		return CLAMP(obj->u.i, INT_MIN, INT_MAX);
+	if (fz_isreal(obj))
+		return obj->u.f;
+	return 0;
+}
+
+fz_off_t fz_tooffset(fz_obj *obj)
 {
 	obj = fz_resolveindirect(obj);
 	if (fz_isint(obj))
@@ -261,10 +336,14 @@ fz_objcmp(fz_obj *a, fz_obj *b)
 		return 0;
 
 	case FZ_BOOL:
-		return a->u.b - b->u.b;
+		return (a->u.i != 0) - (b->u.i != 0);
 
 	case FZ_INT:
-		return a->u.i - b->u.i;
+		if (a->u.i < b->u.i)
+			return -1;
+		if (a->u.i > b->u.i)
+			return 1;
+		return 0;
 
 	case FZ_REAL:
 		if (a->u.f < b->u.f)
@@ -320,6 +399,65 @@ fz_objcmp(fz_obj *a, fz_obj *b)
 	return 1;
 }
 
+/*
+ * Objects that fz_objcmp finds equal hash to the same value.
+ * Indirect references are not followed.
+ */
+unsigned
+fz_objhash(fz_obj *obj)
+{
+	unsigned h;
+	float f;
+	int i;
+
+	if (!obj)
+		return 0;
+
+	h = obj->kind * 31;
+
+	switch (obj->kind)
+	{
+	case FZ_NULL:
+		break;
+	case FZ_BOOL:
+		h += obj->u.i != 0;
+		break;
+	case FZ_INT:
+		h += (unsigned)obj->u.i ^ (unsigned)(obj->u.i >> 31 >> 1);
+		break;
+	case FZ_REAL:
+		/* so that 0 and -0 are the same */
+		f = obj->u.f + 0.0f;
+		for (i = 0; i < sizeof f; i++)
+			h = h * 31 + ((unsigned char *)&f)[i];
+		break;
+	case FZ_STRING:
+		for (i = 0; i < obj->u.s.len; i++)
+			h = h * 31 + (unsigned char)obj->u.s.buf[i];
+		break;
+	case FZ_NAME:
+		for (i = 0; obj->u.n[i]; i++)
+			h = h * 31 + (unsigned char)obj->u.n[i];
+		break;
+	case FZ_INDIRECT:
+		h += obj->u.r.num * 65599 + obj->u.r.gen;
+		break;
+	case FZ_ARRAY:
+		for (i = 0; i < obj->u.a.len; i++)
+			h = h * 31 + fz_objhash(obj->u.a.items[i]);
+		break;
+	case FZ_DICT:
+		for (i = 0; i < obj->u.d.len; i++)
+		{
+			h = h * 31 + fz_objhash(obj->u.d.items[i].k);
+			h = h * 31 + fz_objhash(obj->u.d.items[i].v);
+		}
+		break;
+	}
+
+	return h;
+}
+
 char *fz_objkindstr(fz_obj *obj)
 {
 	if (obj == nil)
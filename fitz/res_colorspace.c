@@ -497,6 +497,32 @@ fz_convertpixmap(fz_pixmap *sp, fz_pixmap *dp)
 
 	assert(ss && ds);
 
+	/* packed pixmaps only need their lookup table converted */
+	if (sp->lookup)
+	{
+		fz_pixmap *slut, *dlut;
+
+		if (!dp->lookup)
+		{
+			slut = fz_unpackpixmap(sp);
+			fz_convertpixmap(slut, dp);
+			fz_droppixmap(slut);
+			return;
+		}
+
+		assert(sp->bpc == dp->bpc);
+		slut = fz_newpixmapwithdata(ss, 0, 0, 1 << sp->bpc, 1, sp->lookup);
+		dlut = fz_newpixmapwithdata(ds, 0, 0, 1 << dp->bpc, 1, dp->lookup);
+		fz_convertpixmap(slut, dlut);
+		fz_droppixmap(slut);
+		fz_droppixmap(dlut);
+
+		if (sp->mask)
+			dp->mask = fz_keeppixmap(sp->mask);
+		dp->interpolate = sp->interpolate;
+		return;
+	}
+
 	if (sp->mask)
 		dp->mask = fz_keeppixmap(sp->mask);
 	dp->interpolate = sp->interpolate;
@@ -20,8 +20,7 @@ fz_newfont(void)
 	font->fthint = 0;
 
 	font->ftfile = nil;
-	font->ftdata = nil;
-	font->ftsize = 0;
+	font->ftbuf = nil;
 
 	font->t3matrix = fz_identity;
 	font->t3resources = nil;
@@ -77,8 +76,8 @@ fz_dropfont(fz_font *font)
 
 		if (font->ftfile)
 			fz_free(font->ftfile);
-		if (font->ftdata)
-			fz_free(font->ftdata);
+		if (font->ftbuf)
+			fz_dropbuffer(font->ftbuf);
 
 		if (font->widthtable)
 			fz_free(font->widthtable);
@@ -33,6 +33,55 @@ fz_newpixmapwithdata(fz_colorspace *colorspace, int x, int y, int w, int h, unsi
 		pix->freesamples = 1;
 	}
 
+	pix->bpc = 8;
+	pix->lookup = nil;
+
+	return pix;
+}
+
+/*
+ * A packed pixmap stores one index of bpc (1, 2, 4 or 8) bits per pixel,
+ * with rows padded to whole bytes. The lookup table has n bytes for each
+ * of the 1 << bpc possible indices and is filled in by the caller.
+ */
+fz_pixmap *
+fz_newpackedpixmap(fz_colorspace *colorspace, int x, int y, int w, int h, int bpc, unsigned char *samples)
+{
+	fz_pixmap *pix;
+
+	assert(bpc == 1 || bpc == 2 || bpc == 4 || bpc == 8);
+
+	pix = fz_malloc(sizeof(fz_pixmap));
+	pix->refs = 1;
+	pix->x = x;
+	pix->y = y;
+	pix->w = w;
+	pix->h = h;
+	pix->mask = nil;
+	pix->interpolate = 1;
+	pix->colorspace = nil;
+	pix->n = 1;
+
+	if (colorspace)
+	{
+		pix->colorspace = fz_keepcolorspace(colorspace);
+		pix->n = 1 + colorspace->n;
+	}
+
+	if (samples)
+	{
+		pix->samples = samples;
+		pix->freesamples = 0;
+	}
+	else
+	{
+		pix->samples = fz_calloc(pix->h, (pix->w * bpc + 7) / 8);
+		pix->freesamples = 1;
+	}
+
+	pix->bpc = bpc;
+	pix->lookup = fz_calloc(1 << bpc, pix->n);
+
 	return pix;
 }
 
@@ -66,6 +115,7 @@ fz_droppixmap(fz_pixmap *pix)
 			fz_dropcolorspace(pix->colorspace);
 		if (pix->freesamples)
 			fz_free(pix->samples);
+		fz_free(pix->lookup);
 		fz_free(pix);
 	}
 }
@@ -108,6 +158,72 @@ fz_boundpixmap(fz_pixmap *pix)
 	return bbox;
 }
 
+/* expand row y of a packed pixmap to w * n bytes at dst */
+void
+fz_unpackpixmaprow(fz_pixmap *pix, int y, unsigned char *dst)
+{
+	unsigned char *sp = pix->samples + y * ((pix->w * pix->bpc + 7) / 8);
+	unsigned char *lookup = pix->lookup;
+	int n = pix->n;
+	int bpc = pix->bpc;
+	int mask = (1 << bpc) - 1;
+	int x, k, bits, shift;
+
+	if (!lookup)
+	{
+		memcpy(dst, pix->samples + y * pix->w * n, pix->w * n);
+		return;
+	}
+
+	if (bpc == 8)
+	{
+		for (x = 0; x < pix->w; x++)
+		{
+			unsigned char *e = lookup + sp[x] * n;
+			for (k = 0; k < n; k++)
+				*dst++ = e[k];
+		}
+		return;
+	}
+
+	bits = 0;
+	shift = 0;
+	for (x = 0; x < pix->w; x++)
+	{
+		unsigned char *e;
+		if (shift == 0)
+		{
+			bits = *sp++;
+			shift = 8;
+		}
+		shift -= bpc;
+		e = lookup + ((bits >> shift) & mask) * n;
+		for (k = 0; k < n; k++)
+			*dst++ = e[k];
+	}
+}
+
+/* return an unpacked version of pix, or pix itself if it isn't packed */
+fz_pixmap *
+fz_unpackpixmap(fz_pixmap *pix)
+{
+	fz_pixmap *dst;
+	int y;
+
+	if (!pix->lookup)
+		return fz_keeppixmap(pix);
+
+	dst = fz_newpixmap(pix->colorspace, pix->x, pix->y, pix->w, pix->h);
+	for (y = 0; y < pix->h; y++)
+		fz_unpackpixmaprow(pix, y, dst->samples + y * pix->w * pix->n);
+
+	if (pix->mask)
+		dst->mask = fz_keeppixmap(pix->mask);
+	dst->interpolate = pix->interpolate;
+
+	return dst;
+}
+
 fz_pixmap *
 fz_alphafromgray(fz_pixmap *gray, int luminosity)
 {
@@ -116,6 +232,7 @@ fz_alphafromgray(fz_pixmap *gray, int luminosity)
 	int len;
 
 	assert(gray->n == 2);
+	assert(!gray->lookup);
 
 	alpha = fz_newpixmap(nil, gray->x, gray->y, gray->w, gray->h);
 	dp = alpha->samples;
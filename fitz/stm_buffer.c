@@ -1,5 +1,12 @@
 #include "fitz.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 fz_buffer *
 fz_newbuffer(int size)
 {
@@ -12,6 +19,87 @@ fz_newbuffer(int size)
 	b->data = fz_malloc(size);
 	b->cap = size;
 	b->len = 0;
+	b->mapped = 0;
+	b->base = nil;
+
+	return b;
+}
+
+/*
+ * A view shares the data of another buffer and keeps it alive.
+ * Resizing a view makes a private copy of the data first.
+ */
+fz_buffer *
+fz_newbufferview(fz_buffer *base, int offset, int len)
+{
+	fz_buffer *b;
+
+	offset = CLAMP(offset, 0, base->len);
+	len = CLAMP(len, 0, base->len - offset);
+
+	b = fz_malloc(sizeof(fz_buffer));
+	b->refs = 1;
+	b->data = base->data + offset;
+	b->cap = len;
+	b->len = len;
+	b->mapped = 0;
+	b->base = fz_keepbuffer(base->base ? base->base : base);
+
+	return b;
+}
+
+/*
+ * Map a whole file into memory. The mapping is private, so writing to
+ * the buffer never touches the file. Returns nil for anything that is
+ * not a regular file, files too large to index with an int, and when
+ * the system refuses; callers then read the file instead.
+ */
+fz_buffer *
+fz_mapfile(int fd)
+{
+	fz_buffer *b;
+	unsigned char *data;
+	int len;
+
+#ifdef _WIN32
+	HANDLE file, map;
+	LARGE_INTEGER size;
+
+	file = (HANDLE)_get_osfhandle(fd);
+	if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size))
+		return nil;
+	if (size.QuadPart <= 0 || size.QuadPart > INT_MAX)
+		return nil;
+	len = size.QuadPart;
+
+	map = CreateFileMapping(file, nil, PAGE_WRITECOPY, 0, 0, nil);
+	if (!map)
+		return nil;
+	data = MapViewOfFile(map, FILE_MAP_COPY, 0, 0, len);
+	CloseHandle(map);
+	if (!data)
+		return nil;
+#else
+	struct stat info;
+
+	if (fstat(fd, &info) < 0)
+		return nil;
+	if (!S_ISREG(info.st_mode) || info.st_size <= 0 || info.st_size > INT_MAX)
+		return nil;
+	len = info.st_size;
+
+	data = mmap(nil, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+		return nil;
+#endif
+
+	b = fz_malloc(sizeof(fz_buffer));
+	b->refs = 1;
+	b->data = data;
+	b->cap = len;
+	b->len = len;
+	b->mapped = 1;
+	b->base = nil;
 
 	return b;
 }
@@ -23,12 +111,27 @@ fz_keepbuffer(fz_buffer *buf)
 	return buf;
 }
 
+static void
+fz_freebufferdata(fz_buffer *buf)
+{
+	if (buf->base)
+		fz_dropbuffer(buf->base);
+	else if (buf->mapped)
+#ifdef _WIN32
+		UnmapViewOfFile(buf->data);
+#else
+		munmap(buf->data, buf->cap);
+#endif
+	else
+		fz_free(buf->data);
+}
+
 void
 fz_dropbuffer(fz_buffer *buf)
 {
 	if (--buf->refs == 0)
 	{
-		fz_free(buf->data);
+		fz_freebufferdata(buf);
 		fz_free(buf);
 	}
 }
@@ -36,7 +139,17 @@ fz_dropbuffer(fz_buffer *buf)
 void
 fz_resizebuffer(fz_buffer *buf, int size)
 {
-	buf->data = fz_realloc(buf->data, size, 1);
+	if (buf->base || buf->mapped)
+	{
+		unsigned char *data = fz_malloc(size);
+		memcpy(data, buf->data, MIN(buf->len, size));
+		fz_freebufferdata(buf);
+		buf->data = data;
+		buf->mapped = 0;
+		buf->base = nil;
+	}
+	else
+		buf->data = fz_realloc(buf->data, size, 1);
 	buf->cap = size;
 	if (buf->len > buf->cap)
 		buf->len = buf->cap;
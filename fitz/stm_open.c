@@ -59,9 +59,9 @@ static int readfile(fz_stream *stm, unsigned char *buf, int len)
 	return n;
 }
 
-static void seekfile(fz_stream *stm, int offset, int whence)
+static void seekfile(fz_stream *stm, fz_off_t offset, int whence)
 {
-	int n = lseek(*(int*)stm->state, offset, whence);
+	fz_off_t n = lseek(*(int*)stm->state, offset, whence);
 	if (n < 0)
 		fz_warn("cannot lseek: %s", strerror(errno));
 	stm->pos = n;
@@ -77,12 +77,25 @@ static void closefile(fz_stream *stm)
 	fz_free(stm->state);
 }
 
+/*
+ * Regular files are opened as a source, so they can be mapped or read
+ * with positional reads. Pipes are read sequentially.
+ */
 fz_stream *
 fz_openfile(int fd)
 {
 	fz_stream *stm;
+	fz_source *src;
 	int *state;
 
+	src = fz_newfilesource(fd);
+	if (src)
+	{
+		stm = fz_opensource(src);
+		fz_dropsource(src);
+		return stm;
+	}
+
 	state = fz_malloc(sizeof(int));
 	*state = fd;
 
@@ -99,15 +112,14 @@ static int readbuffer(fz_stream *stm, unsigned char *buf, int len)
 	return 0;
 }
 
-static void seekbuffer(fz_stream *stm, int offset, int whence)
+static void seekbuffer(fz_stream *stm, fz_off_t offset, int whence)
 {
-	if (whence == 0)
-		stm->rp = stm->bp + offset;
+	fz_off_t len = stm->ep - stm->bp;
 	if (whence == 1)
-		stm->rp += offset;
+		offset += stm->rp - stm->bp;
 	if (whence == 2)
-		stm->rp = stm->ep - offset;
-	stm->rp = CLAMP(stm->rp, stm->bp, stm->ep);
+		offset = len - offset;
+	stm->rp = stm->bp + CLAMP(offset, 0, len);
 	stm->wp = stm->ep;
 }
 
@@ -133,3 +145,19 @@ fz_openbuffer(fz_buffer *buf)
 
 	return stm;
 }
+
+/*
+ * Return the buffer a memory stream reads from, or nil for any
+ * other kind of stream.
+ */
+fz_buffer *
+fz_streambuffer(fz_stream *stm)
+{
+	fz_source *src;
+	if (stm->read == readbuffer)
+		return stm->state;
+	src = fz_streamsource(stm);
+	if (src)
+		return src->buf;
+	return nil;
+}
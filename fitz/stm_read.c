@@ -157,14 +157,14 @@ fz_readline(fz_stream *stm, char *mem, int n)
 		*s = '\0';
 }
 
-int
+fz_off_t
 fz_tell(fz_stream *stm)
 {
 	return stm->pos - (stm->wp - stm->rp);
 }
 
 void
-fz_seek(fz_stream *stm, int offset, int whence)
+fz_seek(fz_stream *stm, fz_off_t offset, int whence)
 {
 	if (stm->seek)
 	{
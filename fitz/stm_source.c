@@ -0,0 +1,258 @@
+#include "fitz.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+/*
+ * A source is random access storage for the bytes of a file. Streams
+ * opened on a source each keep their own position and buffer, so any
+ * number of them can read the same file independently, without
+ * seeking a shared descriptor.
+ */
+
+fz_source *
+fz_newsource(void *state, fz_off_t len,
+	int (*readat)(fz_source *src, fz_off_t ofs, unsigned char *buf, int len),
+	void (*close)(fz_source *src))
+{
+	fz_source *src;
+
+	src = fz_malloc(sizeof(fz_source));
+	src->refs = 1;
+	src->len = len;
+	src->buf = nil;
+	src->state = state;
+	src->readat = readat;
+	src->prefetch = nil;
+	src->close = close;
+
+	return src;
+}
+
+fz_source *
+fz_keepsource(fz_source *src)
+{
+	src->refs ++;
+	return src;
+}
+
+void
+fz_dropsource(fz_source *src)
+{
+	if (--src->refs == 0)
+	{
+		if (src->close)
+			src->close(src);
+		if (src->buf)
+			fz_dropbuffer(src->buf);
+		fz_free(src);
+	}
+}
+
+/*
+ * Tell a source which bytes are going to be read soon.
+ * This is only a hint, and sources are free to ignore it.
+ */
+void
+fz_prefetchsource(fz_source *src, fz_off_t ofs, fz_off_t len)
+{
+	if (!src->prefetch || len <= 0 || ofs >= src->len)
+		return;
+	ofs = MAX(ofs, 0);
+	src->prefetch(src, ofs, MIN(len, src->len - ofs));
+}
+
+/* Memory source */
+
+static int readatbuffer(fz_source *src, fz_off_t ofs, unsigned char *buf, int len)
+{
+	ofs = CLAMP(ofs, 0, src->buf->len);
+	len = MIN(len, src->buf->len - ofs);
+	memcpy(buf, src->buf->data + ofs, len);
+	return len;
+}
+
+fz_source *
+fz_newbuffersource(fz_buffer *buf)
+{
+	fz_source *src = fz_newsource(nil, buf->len, readatbuffer, nil);
+	src->buf = fz_keepbuffer(buf);
+	return src;
+}
+
+/* Mapped files are paged in ahead of time */
+
+#if !defined(_WIN32) && defined(MADV_WILLNEED)
+static void prefetchmapping(fz_source *src, fz_off_t ofs, fz_off_t len)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	fz_off_t start = ofs - ofs % page;
+	madvise(src->buf->data + start, len + (ofs - start), MADV_WILLNEED);
+}
+#endif
+
+/* File source */
+
+static int readatfile(fz_source *src, fz_off_t ofs, unsigned char *buf, int len)
+{
+#ifdef _WIN32
+	HANDLE file = (HANDLE)_get_osfhandle(*(int*)src->state);
+	OVERLAPPED ov;
+	DWORD n;
+
+	memset(&ov, 0, sizeof ov);
+	ov.Offset = (DWORD)ofs;
+	ov.OffsetHigh = (DWORD)(ofs >> 32);
+	if (!ReadFile(file, buf, len, &n, &ov))
+	{
+		if (GetLastError() == ERROR_HANDLE_EOF)
+			return 0;
+		return fz_throw("read error: %d", (int)GetLastError());
+	}
+	return n;
+#else
+	int n = pread(*(int*)src->state, buf, len, ofs);
+	if (n < 0)
+		return fz_throw("read error: %s", strerror(errno));
+	return n;
+#endif
+}
+
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+static void prefetchfile(fz_source *src, fz_off_t ofs, fz_off_t len)
+{
+	posix_fadvise(*(int*)src->state, ofs, len, POSIX_FADV_WILLNEED);
+}
+#endif
+
+static void closefilesource(fz_source *src)
+{
+	int n = close(*(int*)src->state);
+	if (n < 0)
+		fz_warn("close error: %s", strerror(errno));
+	fz_free(src->state);
+}
+
+/*
+ * Take ownership of a file descriptor. The whole file is mapped into
+ * memory if possible, otherwise it is read with positional reads.
+ * Returns nil for pipes and other files we cannot read at random.
+ */
+fz_source *
+fz_newfilesource(int fd)
+{
+	fz_source *src;
+	fz_buffer *buf;
+	fz_off_t len;
+	int *state;
+
+	buf = fz_mapfile(fd);
+	if (buf)
+	{
+		src = fz_newbuffersource(buf);
+#if !defined(_WIN32) && defined(MADV_WILLNEED)
+		src->prefetch = prefetchmapping;
+#endif
+		fz_dropbuffer(buf);
+		/* the mapping outlives the descriptor */
+		close(fd);
+		return src;
+	}
+
+	len = lseek(fd, 0, 2);
+	if (len < 0)
+		return nil;
+
+	state = fz_malloc(sizeof(int));
+	*state = fd;
+
+	src = fz_newsource(state, len, readatfile, closefilesource);
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+	src->prefetch = prefetchfile;
+#endif
+	return src;
+}
+
+/* Streams reading from a source */
+
+static int readsource(fz_stream *stm, unsigned char *buf, int len)
+{
+	fz_source *src = stm->state;
+	if (stm->pos >= src->len)
+		return 0;
+	return src->readat(src, stm->pos, buf, len);
+}
+
+static void seeksource(fz_stream *stm, fz_off_t offset, int whence)
+{
+	fz_source *src = stm->state;
+	if (whence == 1)
+		offset += stm->pos;
+	if (whence == 2)
+		offset += src->len;
+	stm->pos = CLAMP(offset, 0, src->len);
+	stm->rp = stm->bp;
+	stm->wp = stm->bp;
+}
+
+static int readsourcebuffer(fz_stream *stm, unsigned char *buf, int len)
+{
+	return 0;
+}
+
+static void seeksourcebuffer(fz_stream *stm, fz_off_t offset, int whence)
+{
+	fz_off_t len = stm->ep - stm->bp;
+	if (whence == 1)
+		offset += stm->rp - stm->bp;
+	if (whence == 2)
+		offset += len;
+	stm->rp = stm->bp + CLAMP(offset, 0, len);
+	stm->wp = stm->ep;
+}
+
+static void closesource(fz_stream *stm)
+{
+	fz_dropsource(stm->state);
+}
+
+/*
+ * Sources held in memory are read in place: the stream buffer pointers
+ * point into the data, and there is nothing to copy.
+ */
+fz_stream *
+fz_opensource(fz_source *src)
+{
+	fz_stream *stm;
+
+	if (src->buf)
+	{
+		stm = fz_newstream(fz_keepsource(src), readsourcebuffer, closesource);
+		stm->seek = seeksourcebuffer;
+		stm->bp = src->buf->data;
+		stm->rp = src->buf->data;
+		stm->wp = src->buf->data + src->buf->len;
+		stm->ep = src->buf->data + src->buf->len;
+		stm->pos = src->buf->len;
+		return stm;
+	}
+
+	stm = fz_newstream(fz_keepsource(src), readsource, closesource);
+	stm->seek = seeksource;
+	return stm;
+}
+
+/*
+ * Return the source a stream reads from, or nil if it was not opened
+ * with fz_opensource.
+ */
+fz_source *
+fz_streamsource(fz_stream *stm)
+{
+	if (stm->read == readsource || stm->read == readsourcebuffer)
+		return stm->state;
+	return nil;
+}
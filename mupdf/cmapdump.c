@@ -12,6 +12,7 @@
 #include "../fitz/stm_buffer.c"
 #include "../fitz/stm_open.c"
 #include "../fitz/stm_read.c"
+#include "../fitz/stm_source.c"
 
 #include "../mupdf/pdf_lex.c"
 #include "../mupdf/pdf_cmap.c"
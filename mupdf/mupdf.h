@@ -34,12 +34,13 @@ enum
 
 /* lex.c */
 fz_error pdf_lex(int *tok, fz_stream *f, char *buf, int n, int *len);
+int pdf_lexcontent(fz_stream *f, char *buf, int n, double *num);
 
 /* parse.c */
 fz_error pdf_parsearray(fz_obj **op, pdf_xref *xref, fz_stream *f, char *buf, int cap);
 fz_error pdf_parsedict(fz_obj **op, pdf_xref *xref, fz_stream *f, char *buf, int cap);
 fz_error pdf_parsestmobj(fz_obj **op, pdf_xref *xref, fz_stream *f, char *buf, int cap);
-fz_error pdf_parseindobj(fz_obj **op, pdf_xref *xref, fz_stream *f, char *buf, int cap, int *num, int *gen, int *stmofs);
+fz_error pdf_parseindobj(fz_obj **op, pdf_xref *xref, fz_stream *f, char *buf, int cap, int *num, int *gen, fz_off_t *stmofs);
 
 fz_rect pdf_torect(fz_obj *array);
 fz_matrix pdf_tomatrix(fz_obj *array);
@@ -123,31 +124,52 @@ typedef struct pdf_xrefentry_s pdf_xrefentry;
 
 struct pdf_xrefentry_s
 {
-	int ofs;	/* file offset / objstm object number */
+	fz_off_t ofs;	/* file offset / objstm object number */
 	int gen;	/* generation / objstm index */
-	int stmofs;	/* on-disk stream */
+	fz_off_t stmofs;	/* on-disk stream */
 	fz_obj *obj;	/* stored/cached object */
 	int type;	/* 0=unset (f)ree i(n)use (o)bjstm */
+	int age;	/* pdf_agexref sweeps since last use, -1 if it must be kept */
 };
 
 struct pdf_xref_s
 {
 	fz_stream *file;
 	int version;
-	int startxref;
-	int filesize;
+	fz_off_t startxref;
+	fz_off_t filesize;
 	pdf_crypt *crypt;
 	fz_obj *trailer;
 
 	int len;
 	pdf_xrefentry *table;
 
+	/* objects parsed from the file, for pdf_agexref */
+	int agelen;
+	int agecap;
+	int *agelist;
+	int agemark;	/* agelen after the last sweep */
+
+	/* sections whose entries are read as they are needed */
+	int nsections;
+	struct pdf_xrefsection_s *sections;
+
+	/* mapped xref index that entries are read from as they are needed */
+	struct pdf_xrefindex_s *index;
+
+	/* first page of a linearized file */
+	int linpage;
+
 	int pagelen;
 	int pagecap;
+	int lazypages; /* pages are found as they are asked for */
+	int indexpages; /* pages are read from the xref index */
 	fz_obj **pageobjs;
 	fz_obj **pagerefs;
 
 	struct pdf_store_s *store;
+	struct pdf_streamcache_s *streamcache;
+	struct pdf_codecache_s *codecache;
 
 	char scratch[65536];
 };
@@ -155,6 +177,7 @@ struct pdf_xref_s
 fz_error pdf_cacheobject(pdf_xref *, int num, int gen);
 fz_error pdf_loadobject(fz_obj **objp, pdf_xref *, int num, int gen);
 void pdf_updateobject( pdf_xref *xref, int num, int gen, fz_obj *newobj);
+void pdf_agexref(pdf_xref *xref, int maxage);
 
 int pdf_isstream(pdf_xref *xref, int num, int gen);
 fz_stream *pdf_openinlinestream(fz_stream *chain, pdf_xref *xref, fz_obj *stmobj, int length);
@@ -162,32 +185,83 @@ fz_error pdf_loadrawstream(fz_buffer **bufp, pdf_xref *xref, int num, int gen);
 fz_error pdf_loadstream(fz_buffer **bufp, pdf_xref *xref, int num, int gen);
 fz_error pdf_openrawstream(fz_stream **stmp, pdf_xref *, int num, int gen);
 fz_error pdf_openstream(fz_stream **stmp, pdf_xref *, int num, int gen);
-fz_error pdf_openstreamat(fz_stream **stmp, pdf_xref *xref, int num, int gen, fz_obj *dict, int stmofs);
+fz_error pdf_openstreamat(fz_stream **stmp, pdf_xref *xref, int num, int gen, fz_obj *dict, fz_off_t stmofs);
+
+/* decoded stream cache */
+#define PDF_STREAMCACHESIZE (8 << 20)
+typedef struct pdf_streamcache_s pdf_streamcache;
+void pdf_setstreamcachesize(pdf_xref *xref, int maxsize);
+int pdf_streamcachelimit(pdf_xref *xref);
+void pdf_cachestream(pdf_xref *xref, int num, int gen, fz_buffer *buf);
+int pdf_iscachedstream(pdf_xref *xref, int num, int gen);
+void pdf_uncachestream(pdf_xref *xref, int num, int gen);
+void pdf_freestreamcache(pdf_xref *xref);
+void pdf_debugstreamcache(pdf_xref *xref);
 
 fz_error pdf_openxrefwithstream(pdf_xref **xrefp, fz_stream *file, char *password);
+fz_error pdf_openxrefwithsource(pdf_xref **xrefp, fz_source *src, char *password);
 fz_error pdf_openxref(pdf_xref **xrefp, char *filename, char *password);
+fz_error pdf_openxrefwithindex(pdf_xref **xrefp, char *filename, char *password, char *indexname);
 void pdf_freexref(pdf_xref *);
+fz_error pdf_loadlazyxref(pdf_xref *xref);
 
 /* private */
 fz_error pdf_repairxref(pdf_xref *xref, char *buf, int bufsize);
 fz_error pdf_repairobjstms(pdf_xref *xref);
 void pdf_debugxref(pdf_xref *);
 void pdf_resizexref(pdf_xref *xref, int newcap);
+void pdf_prefetchrange(pdf_xref *xref, fz_off_t ofs, fz_off_t len);
+
+/* xref index kept next to the document */
+typedef struct pdf_xrefindex_s pdf_xrefindex;
+typedef struct pdf_indexkey_s pdf_indexkey;
+
+struct pdf_indexkey_s
+{
+	fz_off_t filesize;
+	long long mtime;
+	unsigned int hash;	/* of the trailer region */
+};
+
+fz_error pdf_makeindexkey(pdf_indexkey *key, int fd);
+int pdf_readxrefindex(pdf_xref *xref, char *indexname, pdf_indexkey *key);
+fz_error pdf_writexrefindex(pdf_xref *xref, char *indexname, pdf_indexkey *key);
+void pdf_readindexentry(pdf_xref *xref, int num);
+fz_obj *pdf_loadindexpage(pdf_xref *xref, int i);
+void pdf_freexrefindex(pdf_xref *xref);
 
 /*
  * Resource store
  */
 
+#define PDF_STORESIZE (64<<20)
+
 typedef struct pdf_store_s pdf_store;
+typedef struct pdf_storestats_s pdf_storestats;
+
+struct pdf_storestats_s
+{
+	void *dropfunc;
+	char *name;
+	int count;
+	int size;
+	int hits;
+	int misses;
+	int evictions;
+};
 
 pdf_store *pdf_newstore(void);
 void pdf_freestore(pdf_store *store);
 void pdf_debugstore(pdf_store *store);
+void pdf_debugstorestats(pdf_store *store);
+int pdf_getstorestats(pdf_store *store, pdf_storestats **statsp);
 
-void pdf_storeitem(pdf_store *store, void *keepfn, void *dropfn, fz_obj *key, void *val);
+void *pdf_claimitem(pdf_store *store, void *dropfn, fz_obj *key);
+void pdf_storeitem(pdf_store *store, void *keepfn, void *dropfn, fz_obj *key, void *val, int size);
 void *pdf_finditem(pdf_store *store, void *dropfn, fz_obj *key);
 void pdf_removeitem(pdf_store *store, void *dropfn, fz_obj *key);
 void pdf_agestore(pdf_store *store, int maxage);
+void pdf_setstoresize(pdf_store *store, int maxsize);
 
 /*
  * Functions
@@ -206,6 +280,8 @@ void pdf_dropfunction(pdf_function *func);
 
 fz_error pdf_loadcolorspace(fz_colorspace **csp, pdf_xref *xref, fz_obj *obj);
 fz_pixmap *pdf_expandindexedpixmap(fz_pixmap *src);
+void pdf_expandindexedtile(fz_pixmap *dst, fz_pixmap *src);
+fz_colorspace *pdf_indexedbase(fz_colorspace *cs);
 
 /*
  * Pattern
@@ -264,6 +340,7 @@ void pdf_dropxobject(pdf_xobject *xobj);
 
 fz_error pdf_loadinlineimage(fz_pixmap **imgp, pdf_xref *xref, fz_obj *rdb, fz_obj *dict, fz_stream *file);
 fz_error pdf_loadimage(fz_pixmap **imgp, pdf_xref *xref, fz_obj *obj);
+fz_error pdf_loadimageatsize(fz_pixmap **imgp, pdf_xref *xref, fz_obj *obj, int w, int h);
 int pdf_isjpximage(fz_obj *dict);
 
 /*
@@ -527,11 +604,18 @@ int pdf_getpagecount(pdf_xref *xref);
 fz_obj *pdf_getpageobject(pdf_xref *xref, int p);
 fz_obj *pdf_getpageref(pdf_xref *xref, int p);
 int pdf_findpageobject(pdf_xref *xref, fz_obj *pageobj);
+fz_obj *pdf_lookupinherited(fz_obj *page, char *key);
 
 /* page.c */
 fz_error pdf_loadpage(pdf_page **pagep, pdf_xref *xref, fz_obj *ref);
 void pdf_freepage(pdf_page *page);
 
+/* prefetch.c */
+typedef struct pdf_prefetch_s pdf_prefetch;
+pdf_prefetch *pdf_prefetchpage(pdf_xref *xref, fz_obj *page);
+void pdf_finishprefetch(pdf_prefetch *pf);
+fz_error pdf_warmupxref(pdf_xref *xref);
+
 /*
  * content stream parsing
  */
@@ -650,6 +734,13 @@ fz_error pdf_runxobject(pdf_csi *csi, fz_obj *resources, pdf_xobject *xobj, fz_m
 fz_error pdf_runpage(pdf_xref *xref, pdf_page *page, fz_device *dev, fz_matrix ctm);
 fz_error pdf_runglyph(pdf_xref *xref, fz_obj *resources, fz_buffer *contents, fz_device *dev, fz_matrix ctm);
 
+/* compiled content stream cache */
+#define PDF_CODECACHESIZE (4 << 20)
+typedef struct pdf_codecache_s pdf_codecache;
+void pdf_setcodecachesize(pdf_xref *xref, int maxsize);
+void pdf_freecodecache(pdf_xref *xref);
+void pdf_debugcodecache(pdf_xref *xref);
+
 pdf_material *pdf_keepmaterial(pdf_material *mat);
 pdf_material *pdf_dropmaterial(pdf_material *mat);
 
@@ -14,11 +14,8 @@ pdf_loadembeddedcmap(pdf_cmap **cmapp, pdf_xref *xref, fz_obj *stmobj)
 	fz_obj *wmode;
 	fz_obj *obj;
 
-	if ((*cmapp = pdf_finditem(xref->store, pdf_dropcmap, stmobj)))
-	{
-		pdf_keepcmap(*cmapp);
+	if ((*cmapp = pdf_claimitem(xref->store, pdf_dropcmap, stmobj)))
 		return fz_okay;
-	}
 
 	pdf_logfont("load embedded cmap (%d %d R) {\n", fz_tonum(stmobj), fz_togen(stmobj));
 
@@ -73,7 +70,8 @@ pdf_loadembeddedcmap(pdf_cmap **cmapp, pdf_xref *xref, fz_obj *stmobj)
 
 	pdf_logfont("}\n");
 
-	pdf_storeitem(xref->store, pdf_keepcmap, pdf_dropcmap, stmobj, cmap);
+	pdf_storeitem(xref->store, pdf_keepcmap, pdf_dropcmap, stmobj, cmap,
+		sizeof(pdf_cmap) + cmap->rcap * sizeof(pdf_range) + cmap->tcap * sizeof(unsigned short));
 
 	*cmapp = cmap;
 	return fz_okay;
@@ -182,13 +182,22 @@ freeindexed(fz_colorspace *cs)
 	fz_free(idx);
 }
 
-fz_pixmap *
-pdf_expandindexedpixmap(fz_pixmap *src)
+fz_colorspace *
+pdf_indexedbase(fz_colorspace *cs)
+{
+	struct indexed *idx;
+	assert(cs->toxyz == indexedtoxyz);
+	idx = cs->data;
+	return idx->base;
+}
+
+/* expand the rows of src into dst, which must be the same size and in the base colorspace */
+void
+pdf_expandindexedtile(fz_pixmap *dst, fz_pixmap *src)
 {
 	struct indexed *idx;
-	fz_pixmap *dst;
 	unsigned char *s, *d;
-	int y, x, k, n, high;
+	int len, k, n, high;
 	unsigned char *lookup;
 
 	assert(src->colorspace->toxyz == indexedtoxyz);
@@ -199,22 +208,31 @@ pdf_expandindexedpixmap(fz_pixmap *src)
 	lookup = idx->lookup;
 	n = idx->base->n;
 
-	dst = fz_newpixmap(idx->base, src->x, src->y, src->w, src->h);
+	assert(dst->n == n + 1);
+	assert(dst->w == src->w && dst->h == src->h);
+
 	s = src->samples;
 	d = dst->samples;
+	len = src->w * src->h;
 
-	for (y = 0; y < src->h; y++)
+	while (len--)
 	{
-		for (x = 0; x < src->w; x++)
-		{
-			int v = *s++;
-			int a = *s++;
-			v = MIN(v, high);
-			for (k = 0; k < n; k++)
-				*d++ = fz_mul255(lookup[v * n + k], a);
-			*d++ = a;
-		}
+		int v = *s++;
+		int a = *s++;
+		v = MIN(v, high);
+		for (k = 0; k < n; k++)
+			*d++ = fz_mul255(lookup[v * n + k], a);
+		*d++ = a;
 	}
+}
+
+fz_pixmap *
+pdf_expandindexedpixmap(fz_pixmap *src)
+{
+	fz_pixmap *dst;
+
+	dst = fz_newpixmap(pdf_indexedbase(src->colorspace), src->x, src->y, src->w, src->h);
+	pdf_expandindexedtile(dst, src);
 
 	if (src->mask)
 		dst->mask = fz_keeppixmap(src->mask);
@@ -397,17 +415,14 @@ pdf_loadcolorspace(fz_colorspace **csp, pdf_xref *xref, fz_obj *obj)
 {
 	fz_error error;
 
-	if ((*csp = pdf_finditem(xref->store, fz_dropcolorspace, obj)))
-	{
-		fz_keepcolorspace(*csp);
+	if ((*csp = pdf_claimitem(xref->store, fz_dropcolorspace, obj)))
 		return fz_okay;
-	}
 
 	error = pdf_loadcolorspaceimp(csp, xref, obj);
 	if (error)
 		return fz_rethrow(error, "cannot load colorspace (%d %d R)", fz_tonum(obj), fz_togen(obj));
 
-	pdf_storeitem(xref->store, fz_keepcolorspace, fz_dropcolorspace, obj, *csp);
+	pdf_storeitem(xref->store, fz_keepcolorspace, fz_dropcolorspace, obj, *csp, sizeof(fz_colorspace));
 
 	return fz_okay;
 }
@@ -956,6 +956,32 @@ pdf_makewidthtable(pdf_fontdesc *fontdesc)
 	}
 }
 
+static int
+pdf_fontsize(pdf_fontdesc *fontdesc)
+{
+	fz_font *font = fontdesc->font;
+	int size = sizeof(pdf_fontdesc) + sizeof(fz_font);
+	int i;
+
+	size += fontdesc->hmtxcap * sizeof(pdf_hmtx);
+	size += fontdesc->vmtxcap * sizeof(pdf_vmtx);
+	size += fontdesc->ncidtogid * sizeof(unsigned short);
+	size += fontdesc->ncidtoucs * sizeof(unsigned short);
+
+	if (font->ftbuf)
+		size += font->ftbuf->len;
+	if (font->t3procs)
+	{
+		size += 256 * (sizeof(fz_buffer*) + sizeof(float));
+		for (i = 0; i < 256; i++)
+			if (font->t3procs[i])
+				size += font->t3procs[i]->len;
+	}
+	size += font->widthcount * sizeof(int);
+
+	return size;
+}
+
 fz_error
 pdf_loadfont(pdf_fontdesc **fontdescp, pdf_xref *xref, fz_obj *rdb, fz_obj *dict)
 {
@@ -964,11 +990,8 @@ pdf_loadfont(pdf_fontdesc **fontdescp, pdf_xref *xref, fz_obj *rdb, fz_obj *dict
 	fz_obj *dfonts;
 	fz_obj *charprocs;
 
-	if ((*fontdescp = pdf_finditem(xref->store, pdf_dropfont, dict)))
-	{
-		pdf_keepfont(*fontdescp);
+	if ((*fontdescp = pdf_claimitem(xref->store, pdf_dropfont, dict)))
 		return fz_okay;
-	}
 
 	subtype = fz_toname(fz_dictgets(dict, "Subtype"));
 	dfonts = fz_dictgets(dict, "DescendantFonts");
@@ -1006,7 +1029,7 @@ pdf_loadfont(pdf_fontdesc **fontdescp, pdf_xref *xref, fz_obj *rdb, fz_obj *dict
 	if ((*fontdescp)->font->ftsubstitute && !(*fontdescp)->tottfcmap)
 		pdf_makewidthtable(*fontdescp);
 
-	pdf_storeitem(xref->store, pdf_keepfont, pdf_dropfont, dict, *fontdescp);
+	pdf_storeitem(xref->store, pdf_keepfont, pdf_dropfont, dict, *fontdescp, pdf_fontsize(*fontdescp));
 
 	return fz_okay;
 }
@@ -284,10 +284,8 @@ pdf_loadembeddedfont(pdf_fontdesc *fontdesc, pdf_xref *xref, fz_obj *stmref)
 		return fz_rethrow(error, "cannot load embedded font (%d %d R)", fz_tonum(stmref), fz_togen(stmref));
 	}
 
-	/* save the buffer so we can free it later */
-	fontdesc->font->ftdata = buf->data;
-	fontdesc->font->ftsize = buf->len;
-	fz_free(buf); /* only free the fz_buffer struct, not the contained data */
+	/* freetype reads the data in place, so keep the buffer for the font */
+	fontdesc->font->ftbuf = buf;
 
 	fontdesc->isembedded = 1;
 
@@ -1370,6 +1370,30 @@ pdf_dropfunction(pdf_function *func)
 	}
 }
 
+static int
+pdf_functionsize(pdf_function *func)
+{
+	int size = sizeof(pdf_function);
+	int i, count;
+
+	switch (func->type)
+	{
+	case SAMPLE:
+		for (i = 0, count = func->n; i < func->m; i++)
+			count *= func->u.sa.size[i];
+		size += count * sizeof(float);
+		break;
+	case STITCHING:
+		size += func->u.st.k * (sizeof(pdf_function*) + 3 * sizeof(float));
+		break;
+	case POSTSCRIPT:
+		size += func->u.p.cap * sizeof(psobj);
+		break;
+	}
+
+	return size;
+}
+
 fz_error
 pdf_loadfunction(pdf_function **funcp, pdf_xref *xref, fz_obj *dict)
 {
@@ -1378,11 +1402,8 @@ pdf_loadfunction(pdf_function **funcp, pdf_xref *xref, fz_obj *dict)
 	fz_obj *obj;
 	int i;
 
-	if ((*funcp = pdf_finditem(xref->store, pdf_dropfunction, dict)))
-	{
-		pdf_keepfunction(*funcp);
+	if ((*funcp = pdf_claimitem(xref->store, pdf_dropfunction, dict)))
 		return fz_okay;
-	}
 
 	pdf_logrsrc("load function (%d %d R) {\n", fz_tonum(dict), fz_togen(dict));
 
@@ -1475,7 +1496,7 @@ pdf_loadfunction(pdf_function **funcp, pdf_xref *xref, fz_obj *dict)
 
 	pdf_logrsrc("}\n");
 
-	pdf_storeitem(xref->store, pdf_keepfunction, pdf_dropfunction, dict, func);
+	pdf_storeitem(xref->store, pdf_keepfunction, pdf_dropfunction, dict, func, pdf_functionsize(func));
 
 	*funcp = func;
 	return fz_okay;
@@ -4,7 +4,10 @@
 /* TODO: store JPEG compressed samples */
 /* TODO: store flate compressed samples */
 
-static fz_error pdf_loadjpximage(fz_pixmap **imgp, pdf_xref *xref, fz_obj *dict);
+/* decode images in strips of roughly this many bytes of packed samples */
+#define STRIPSIZE (64 << 10)
+
+static fz_error pdf_loadjpximage(fz_pixmap **imgp, pdf_xref *xref, fz_obj *dict, int reduce);
 
 static void
 pdf_maskcolorkey(fz_pixmap *pix, int n, int *colorkey)
@@ -25,8 +28,43 @@ pdf_maskcolorkey(fz_pixmap *pix, int n, int *colorkey)
 	}
 }
 
+/*
+ * Fill in the lookup table of a packed image by running every possible
+ * sample value through the same decode and expansion as unpacked images.
+ */
+static void
+pdf_loadimagelookup(fz_pixmap *tile, fz_colorspace *colorspace, int indexed, float *decode, int bpc, int scale)
+{
+	fz_pixmap *src, *dst;
+	int count = 1 << bpc;
+	int i;
+
+	src = fz_newpixmap(colorspace, 0, 0, count, 1);
+	for (i = 0; i < count; i++)
+	{
+		src->samples[i * src->n] = i * scale;
+		if (src->n > 1)
+			src->samples[i * src->n + 1] = 255;
+	}
+
+	if (indexed)
+	{
+		fz_decodeindexedtile(src, decode, count - 1);
+		dst = fz_newpixmapwithdata(tile->colorspace, 0, 0, count, 1, tile->lookup);
+		pdf_expandindexedtile(dst, src);
+		fz_droppixmap(dst);
+	}
+	else
+	{
+		fz_decodetile(src, decode);
+		memcpy(tile->lookup, src->samples, count * src->n);
+	}
+
+	fz_droppixmap(src);
+}
+
 static fz_error
-pdf_loadimageimp(fz_pixmap **imgp, pdf_xref *xref, fz_obj *rdb, fz_obj *dict, fz_stream *cstm, int forcemask)
+pdf_loadimageimp(fz_pixmap **imgp, pdf_xref *xref, fz_obj *rdb, fz_obj *dict, fz_stream *cstm, int forcemask, int reduce)
 {
 	fz_stream *stm;
 	fz_pixmap *tile;
@@ -46,13 +84,16 @@ pdf_loadimageimp(fz_pixmap **imgp, pdf_xref *xref, fz_obj *rdb, fz_obj *dict, fz
 	int scale;
 	int stride;
 	unsigned char *samples;
-	int i, len;
+	fz_pixmap *itile;
+	int striph, rows, truncated;
+	int packed;
+	int i, y, len;
 
 	/* special case for JPEG2000 images */
 	if (pdf_isjpximage(dict))
 	{
 		tile = nil;
-		error = pdf_loadjpximage(&tile, xref, dict);
+		error = pdf_loadjpximage(&tile, xref, dict, reduce);
 		if (error)
 			return fz_rethrow(error, "cannot load jpx image");
 		if (forcemask)
@@ -140,7 +181,7 @@ pdf_loadimageimp(fz_pixmap **imgp, pdf_xref *xref, fz_obj *rdb, fz_obj *dict, fz
 		/* Not allowed for inline images */
 		if (!cstm)
 		{
-			error = pdf_loadimageimp(&mask, xref, rdb, obj, nil, 1);
+			error = pdf_loadimageimp(&mask, xref, rdb, obj, nil, 1, 0);
 			if (error)
 			{
 				if (colorspace)
@@ -157,7 +198,6 @@ pdf_loadimageimp(fz_pixmap **imgp, pdf_xref *xref, fz_obj *rdb, fz_obj *dict, fz
 	}
 
 	stride = (w * n * bpc + 7) / 8;
-	samples = fz_calloc(h, stride);
 
 	if (cstm)
 	{
@@ -176,84 +216,145 @@ pdf_loadimageimp(fz_pixmap **imgp, pdf_xref *xref, fz_obj *rdb, fz_obj *dict, fz
 		}
 	}
 
-	len = fz_read(stm, samples, h * stride);
-	if (len < 0)
-	{
-		fz_close(stm);
-		if (colorspace)
-			fz_dropcolorspace(colorspace);
-		if (mask)
-			fz_droppixmap(mask);
-		return fz_rethrow(len, "cannot read image data");
-	}
+	pdf_logimage("size %dx%d n=%d bpc=%d imagemask=%d indexed=%d\n", w, h, n, bpc, imagemask, indexed);
 
-	/* Make sure we read the EOF marker (for inline images only) */
-	if (cstm)
+	/*
+	 * Read, unpack, decode and expand the samples a strip of rows at a time
+	 * straight into the final pixmap, so that we never hold more than one
+	 * full size copy of the image.
+	 */
+
+	scale = 1;
+	if (!indexed)
 	{
-		unsigned char tbuf[512];
-		int tlen = fz_read(stm, tbuf, sizeof tbuf);
-		if (tlen < 0)
-			fz_catch(tlen, "ignoring error at end of image");
-		if (tlen > 0)
-			fz_warn("ignoring garbage at end of image");
+		switch (bpc)
+		{
+		case 1: scale = 255; break;
+		case 2: scale = 85; break;
+		case 4: scale = 17; break;
+		}
 	}
 
-	fz_close(stm);
+	/*
+	 * Single component images of less than 8 bits and indexed images
+	 * are kept packed, and expanded through a lookup table when drawn.
+	 */
+	packed = n == 1 && !usecolorkey &&
+		(bpc == 1 || bpc == 2 || bpc == 4 || (bpc == 8 && indexed));
+
+	striph = CLAMP(STRIPSIZE / stride, 1, h);
+	samples = nil;
 
-	/* Pad truncated images */
-	if (len < stride * h)
+	if (packed)
 	{
-		fz_warn("padding truncated image (%d 0 R)", fz_tonum(dict));
-		memset(samples + len, 0, stride * h - len);
+		tile = fz_newpackedpixmap(indexed ? pdf_indexedbase(colorspace) : colorspace, 0, 0, w, h, bpc, nil);
+		itile = nil;
 	}
-
-	/* Invert 1-bit image masks */
-	if (imagemask)
+	else if (indexed)
 	{
-		/* 0=opaque and 1=transparent so we need to invert */
-		unsigned char *p = samples;
-		len = h * stride;
-		for (i = 0; i < len; i++)
-			p[i] = ~p[i];
+		samples = fz_calloc(striph, stride);
+		tile = fz_newpixmap(pdf_indexedbase(colorspace), 0, 0, w, h);
+		itile = fz_newpixmap(colorspace, 0, 0, w, striph);
+	}
+	else
+	{
+		samples = fz_calloc(striph, stride);
+		tile = fz_newpixmap(colorspace, 0, 0, w, h);
+		itile = nil;
 	}
 
-	pdf_logimage("size %dx%d n=%d bpc=%d imagemask=%d indexed=%d\n", w, h, n, bpc, imagemask, indexed);
+	truncated = 0;
 
-	/* Unpack samples into pixmap */
+	for (y = 0; y < h; y += rows)
+	{
+		fz_pixmap *strip;
+		unsigned char *sp;
 
-	tile = fz_newpixmap(colorspace, 0, 0, w, h);
+		rows = MIN(striph, h - y);
 
-	scale = 1;
-	if (!indexed)
-	{
-		switch (bpc)
+		/* packed samples are read straight into place */
+		sp = packed ? tile->samples + y * stride : samples;
+
+		len = fz_read(stm, sp, rows * stride);
+		if (len < 0)
 		{
-		case 1: scale = 255; break;
-		case 2: scale = 85; break;
-		case 4: scale = 17; break;
+			fz_close(stm);
+			fz_free(samples);
+			fz_droppixmap(tile);
+			if (itile)
+				fz_droppixmap(itile);
+			if (colorspace)
+				fz_dropcolorspace(colorspace);
+			if (mask)
+				fz_droppixmap(mask);
+			return fz_rethrow(len, "cannot read image data");
+		}
+
+		/* Pad truncated images */
+		if (len < stride * rows)
+		{
+			if (!truncated)
+				fz_warn("padding truncated image (%d 0 R)", fz_tonum(dict));
+			truncated = 1;
+			memset(sp + len, 0, stride * rows - len);
 		}
-	}
 
-	fz_unpacktile(tile, samples, n, bpc, stride, scale);
+		/* Invert 1-bit image masks */
+		if (imagemask)
+		{
+			/* 0=opaque and 1=transparent so we need to invert */
+			len = rows * stride;
+			for (i = 0; i < len; i++)
+				sp[i] = ~sp[i];
+		}
 
-	if (usecolorkey)
-		pdf_maskcolorkey(tile, n, colorkey);
+		if (packed)
+			continue;
 
-	if (indexed)
-	{
-		fz_pixmap *conv;
+		/* Unpack samples into the destination rows */
+
+		strip = fz_newpixmapwithdata(tile->colorspace, 0, y, w, rows,
+			tile->samples + y * w * tile->n);
 
-		fz_decodeindexedtile(tile, decode, (1 << bpc) - 1);
+		if (indexed)
+		{
+			itile->y = y;
+			itile->h = rows;
+			fz_unpacktile(itile, samples, n, bpc, stride, scale);
+			if (usecolorkey)
+				pdf_maskcolorkey(itile, n, colorkey);
+			fz_decodeindexedtile(itile, decode, (1 << bpc) - 1);
+			pdf_expandindexedtile(strip, itile);
+		}
+		else
+		{
+			fz_unpacktile(strip, samples, n, bpc, stride, scale);
+			if (usecolorkey)
+				pdf_maskcolorkey(strip, n, colorkey);
+			fz_decodetile(strip, decode);
+		}
 
-		conv = pdf_expandindexedpixmap(tile);
-		fz_droppixmap(tile);
-		tile = conv;
+		fz_droppixmap(strip);
 	}
-	else
+
+	/* Make sure we read the EOF marker (for inline images only) */
+	if (cstm)
 	{
-		fz_decodetile(tile, decode);
+		unsigned char tbuf[512];
+		int tlen = fz_read(stm, tbuf, sizeof tbuf);
+		if (tlen < 0)
+			fz_catch(tlen, "ignoring error at end of image");
+		if (tlen > 0)
+			fz_warn("ignoring garbage at end of image");
 	}
 
+	fz_close(stm);
+
+	if (packed)
+		pdf_loadimagelookup(tile, colorspace, indexed, decode, bpc, scale);
+
+	if (itile)
+		fz_droppixmap(itile);
 	if (colorspace)
 		fz_dropcolorspace(colorspace);
 
@@ -273,7 +374,7 @@ pdf_loadinlineimage(fz_pixmap **pixp, pdf_xref *xref, fz_obj *rdb, fz_obj *dict,
 
 	pdf_logimage("load inline image {\n");
 
-	error = pdf_loadimageimp(pixp, xref, rdb, dict, file, 0);
+	error = pdf_loadimageimp(pixp, xref, rdb, dict, file, 0, 0);
 	if (error)
 		return fz_rethrow(error, "cannot load inline image");
 
@@ -298,7 +399,7 @@ pdf_isjpximage(fz_obj *dict)
 }
 
 static fz_error
-pdf_loadjpximage(fz_pixmap **imgp, pdf_xref *xref, fz_obj *dict)
+pdf_loadjpximage(fz_pixmap **imgp, pdf_xref *xref, fz_obj *dict, int reduce)
 {
 	fz_error error;
 	fz_buffer *buf;
@@ -311,7 +412,7 @@ pdf_loadjpximage(fz_pixmap **imgp, pdf_xref *xref, fz_obj *dict)
 	if (error)
 		return fz_rethrow(error, "cannot load jpx image data");
 
-	error = fz_loadjpximage(&img, buf->data, buf->len);
+	error = fz_loadjpximage(&img, buf->data, buf->len, reduce);
 	if (error)
 	{
 		fz_dropbuffer(buf);
@@ -323,7 +424,7 @@ pdf_loadjpximage(fz_pixmap **imgp, pdf_xref *xref, fz_obj *dict)
 	obj = fz_dictgetsa(dict, "SMask", "Mask");
 	if (fz_isdict(obj))
 	{
-		error = pdf_loadimageimp(&img->mask, xref, nil, obj, nil, 1);
+		error = pdf_loadimageimp(&img->mask, xref, nil, obj, nil, 1, 0);
 		if (error)
 		{
 			fz_droppixmap(img);
@@ -366,26 +467,86 @@ pdf_loadjpximage(fz_pixmap **imgp, pdf_xref *xref, fz_obj *dict)
 	return fz_okay;
 }
 
+/*
+ * JPEG 2000 images can be decoded at a fraction of their full size for
+ * free, so when we know how many device pixels an image will cover we
+ * ask for the smallest resolution level that is still at least that big.
+ * A cached image that turns out to be too small is replaced.
+ */
+
+#define MAXREDUCE 5
+
+static int
+pdf_imagereduction(fz_obj *dict, int w, int h)
+{
+	int imgw, imgh, reduce;
+
+	if (w <= 0 || h <= 0 || !pdf_isjpximage(dict))
+		return 0;
+
+	imgw = fz_toint(fz_dictgets(dict, "Width"));
+	imgh = fz_toint(fz_dictgets(dict, "Height"));
+
+	reduce = 0;
+	while (reduce < MAXREDUCE && (imgw >> (reduce + 1)) >= w && (imgh >> (reduce + 1)) >= h)
+		reduce++;
+	return reduce;
+}
+
+static int
+pdf_pixmapsize(fz_pixmap *pix)
+{
+	int size = sizeof(fz_pixmap);
+	if (pix->bpc < 8)
+		size += pix->h * ((pix->w * pix->bpc + 7) / 8) + (1 << pix->bpc) * pix->n;
+	else
+		size += pix->w * pix->h * pix->n;
+	if (pix->mask)
+		size += pdf_pixmapsize(pix->mask);
+	return size;
+}
+
 fz_error
-pdf_loadimage(fz_pixmap **pixp, pdf_xref *xref, fz_obj *dict)
+pdf_loadimageatsize(fz_pixmap **pixp, pdf_xref *xref, fz_obj *dict, int w, int h)
 {
 	fz_error error;
+	fz_pixmap *img;
+	int reduce;
+	int reload;
+
+	reduce = pdf_imagereduction(dict, w, h);
 
-	if ((*pixp = pdf_finditem(xref->store, fz_droppixmap, dict)))
+	/* a JPX image stored at a lower resolution is loaded again */
+	reload = 0;
+	img = pdf_claimitem(xref->store, fz_droppixmap, dict);
+	if (img)
 	{
-		fz_keeppixmap(*pixp);
-		return fz_okay;
+		if (!pdf_isjpximage(dict) || img->w >= (fz_toint(fz_dictgets(dict, "Width")) >> reduce))
+		{
+			*pixp = img;
+			return fz_okay;
+		}
+		fz_droppixmap(img);
+		reload = 1;
 	}
 
-	pdf_logimage("load image (%d 0 R) {\n", fz_tonum(dict));
+	pdf_logimage("load image (%d 0 R) reduce %d {\n", fz_tonum(dict), reduce);
 
-	error = pdf_loadimageimp(pixp, xref, nil, dict, nil, 0);
+	error = pdf_loadimageimp(pixp, xref, nil, dict, nil, 0, reduce);
 	if (error)
 		return fz_rethrow(error, "cannot load image (%d 0 R)", fz_tonum(dict));
 
-	pdf_storeitem(xref->store, fz_keeppixmap, fz_droppixmap, dict, *pixp);
+	if (reload)
+		pdf_removeitem(xref->store, fz_droppixmap, dict);
+	pdf_storeitem(xref->store, fz_keeppixmap, fz_droppixmap, dict, *pixp, pdf_pixmapsize(*pixp));
 
 	pdf_logimage("}\n");
 
 	return fz_okay;
 }
+
+fz_error
+pdf_loadimage(fz_pixmap **pixp, pdf_xref *xref, fz_obj *dict)
+{
+	return pdf_loadimageatsize(pixp, xref, dict, 0, 0);
+}
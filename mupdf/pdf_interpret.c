@@ -490,7 +490,7 @@ static fz_error pdf_run_cs_imp(pdf_csi *csi, fz_obj *rdb, int what)
 			colorspace = fz_keepcolorspace(fz_devicecmyk);
 		else
 		{
-			dict = fz_dictgets(rdb, "ColorSpace");
+			dict = fz_dictget(rdb, FZ_NAME(ColorSpace));
 			if (!dict)
 				return fz_throw("cannot find ColorSpace dictionary");
 			obj = fz_dictgets(dict, csi->name);
@@ -535,7 +535,7 @@ static fz_error pdf_run_Do(pdf_csi *csi, fz_obj *rdb)
 	fz_obj *subtype;
 	fz_error error;
 
-	dict = fz_dictgets(rdb, "XObject");
+	dict = fz_dictget(rdb, FZ_NAME(XObject));
 	if (!dict)
 		return fz_throw("cannot find XObject dictionary when looking for: '%s'", csi->name);
 
@@ -543,12 +543,12 @@ static fz_error pdf_run_Do(pdf_csi *csi, fz_obj *rdb)
 	if (!obj)
 		return fz_throw("cannot find xobject resource: '%s'", csi->name);
 
-	subtype = fz_dictgets(obj, "Subtype");
+	subtype = fz_dictget(obj, FZ_NAME(Subtype));
 	if (!fz_isname(subtype))
 		return fz_throw("no XObject subtype specified");
 
-	if (!strcmp(fz_toname(subtype), "Form") && fz_dictgets(obj, "Subtype2"))
-		subtype = fz_dictgets(obj, "Subtype2");
+	if (!strcmp(fz_toname(subtype), "Form") && fz_dictget(obj, FZ_NAME(Subtype2)))
+		subtype = fz_dictget(obj, FZ_NAME(Subtype2));
 
 	if (!strcmp(fz_toname(subtype), "Form"))
 	{
@@ -573,8 +573,17 @@ static fz_error pdf_run_Do(pdf_csi *csi, fz_obj *rdb)
 	{
 		if ((csi->dev->hints & FZ_IGNOREIMAGE) == 0)
 		{
+			pdf_gstate *gstate = csi->gstate + csi->gtop;
+			fz_matrix ctm = gstate->ctm;
 			fz_pixmap *img;
-			error = pdf_loadimage(&img, csi->xref, obj);
+			int w = 0, h = 0;
+			/* the image fills the unit square, so its device size is the length of the ctm axes */
+			if (csi->dev->hints & FZ_REDUCEIMAGE)
+			{
+				w = ceilf(sqrtf(ctm.a * ctm.a + ctm.b * ctm.b));
+				h = ceilf(sqrtf(ctm.c * ctm.c + ctm.d * ctm.d));
+			}
+			error = pdf_loadimageatsize(&img, csi->xref, obj, w, h);
 			if (error)
 				return fz_rethrow(error, "cannot load image (%d %d R)", fz_tonum(obj), fz_togen(obj));
 			pdf_showimage(csi, img);
@@ -682,7 +691,7 @@ static fz_error pdf_run_SC_imp(pdf_csi *csi, fz_obj *rdb, int what, pdf_material
 		break;
 
 	case PDF_MPATTERN:
-		dict = fz_dictgets(rdb, "Pattern");
+		dict = fz_dictget(rdb, FZ_NAME(Pattern));
 		if (!dict)
 			return fz_throw("cannot find Pattern dictionary");
 
@@ -690,7 +699,7 @@ static fz_error pdf_run_SC_imp(pdf_csi *csi, fz_obj *rdb, int what, pdf_material
 		if (!obj)
 			return fz_throw("cannot find pattern resource '%s'", csi->name);
 
-		patterntype = fz_dictgets(obj, "PatternType");
+		patterntype = fz_dictget(obj, FZ_NAME(PatternType));
 
 		if (fz_toint(patterntype) == 1)
 		{
@@ -775,9 +784,13 @@ static fz_error pdf_run_Tf(pdf_csi *csi, fz_obj *rdb)
 	fz_obj *obj;
 
 	gstate->size = csi->stack[0];
-	gstate->font = nil;
+	if (gstate->font)
+	{
+		pdf_dropfont(gstate->font);
+		gstate->font = nil;
+	}
 
-	dict = fz_dictgets(rdb, "Font");
+	dict = fz_dictget(rdb, FZ_NAME(Font));
 	if (!dict)
 		return fz_throw("cannot find Font dictionary");
 
@@ -785,12 +798,6 @@ static fz_error pdf_run_Tf(pdf_csi *csi, fz_obj *rdb)
 	if (!obj)
 		return fz_throw("cannot find font resource: '%s'", csi->name);
 
-	if (gstate->font)
-	{
-		pdf_dropfont(gstate->font);
-		gstate->font = nil;
-	}
-
 	error = pdf_loadfont(&gstate->font, csi->xref, rdb, obj);
 	if (error)
 		return fz_rethrow(error, "cannot load font (%d 0 R)", fz_tonum(obj));
@@ -956,7 +963,7 @@ static fz_error pdf_run_gs(pdf_csi *csi, fz_obj *rdb)
 	fz_obj *dict;
 	fz_obj *obj;
 
-	dict = fz_dictgets(rdb, "ExtGState");
+	dict = fz_dictget(rdb, FZ_NAME(ExtGState));
 	if (!dict)
 		return fz_throw("cannot find ExtGState dictionary");
 
@@ -1055,7 +1062,7 @@ static fz_error pdf_run_sh(pdf_csi *csi, fz_obj *rdb)
 	fz_shade *shd;
 	fz_error error;
 
-	dict = fz_dictgets(rdb, "Shading");
+	dict = fz_dictget(rdb, FZ_NAME(Shading));
 	if (!dict)
 		return fz_throw("cannot find shading dictionary");
 
@@ -1257,10 +1264,28 @@ pdf_runkeyword(pdf_csi *csi, fz_obj *rdb, fz_stream *file, char *buf)
 	return fz_okay;
 }
 
+static fz_error
+pdf_lexcsi(int *tok, fz_stream *file, char *buf, int buflen, int *len, double *num)
+{
+	fz_error error;
+
+	*tok = pdf_lexcontent(file, buf, buflen, num);
+	if (*tok != PDF_TERROR)
+		return fz_okay;
+
+	error = pdf_lex(tok, file, buf, buflen, len);
+	if (error)
+		return fz_rethrow(error, "lexical error");
+	if (*tok == PDF_TINT || *tok == PDF_TREAL)
+		*num = atof(buf);
+	return fz_okay;
+}
+
 static fz_error
 pdf_runcsifile(pdf_csi *csi, fz_obj *rdb, fz_stream *file, char *buf, int buflen)
 {
 	fz_error error;
+	double num = 0;
 	int tok;
 	int len;
 
@@ -1271,7 +1296,7 @@ pdf_runcsifile(pdf_csi *csi, fz_obj *rdb, fz_stream *file, char *buf, int buflen
 		if (csi->top == nelem(csi->stack) - 1)
 			return fz_throw("stack overflow");
 
-		error = pdf_lex(&tok, file, buf, buflen, &len);
+		error = pdf_lexcsi(&tok, file, buf, buflen, &len, &num);
 		if (error)
 			return fz_rethrow(error, "lexical error in content stream");
 
@@ -1284,7 +1309,7 @@ pdf_runcsifile(pdf_csi *csi, fz_obj *rdb, fz_stream *file, char *buf, int buflen
 			else if (tok == PDF_TINT || tok == PDF_TREAL)
 			{
 				pdf_gstate *gstate = csi->gstate + csi->gtop;
-				pdf_showspace(csi, -atof(buf) * gstate->size * 0.001f);
+				pdf_showspace(csi, -num * gstate->size * 0.001f);
 			}
 			else if (tok == PDF_TSTRING)
 			{
@@ -1331,12 +1356,8 @@ pdf_runcsifile(pdf_csi *csi, fz_obj *rdb, fz_stream *file, char *buf, int buflen
 			break;
 
 		case PDF_TINT:
-			csi->stack[csi->top] = atoi(buf);
-			csi->top ++;
-			break;
-
 		case PDF_TREAL:
-			csi->stack[csi->top] = atof(buf);
+			csi->stack[csi->top] = num;
 			csi->top ++;
 			break;
 
@@ -1366,14 +1387,579 @@ pdf_runcsifile(pdf_csi *csi, fz_obj *rdb, fz_stream *file, char *buf, int buflen
 	}
 }
 
+/*
+ * Compiled content streams.
+ *
+ * Forms, tiling patterns and Type 3 glyphs are run over and over. The
+ * second time a content buffer is run, it is lexed once into an array
+ * of operations, with the numbers converted and the arrays and dicts
+ * parsed, and it is run from that array after that. The compiled code
+ * is kept in a cache keyed on the buffer, in least recently used order
+ * within a budget. Compiled entries keep their buffer, so that no other
+ * buffer can turn up at the same address. Streams with inline images,
+ * and streams that failed or ended inside an array the first time,
+ * are not compiled and are always lexed.
+ */
+
+typedef struct pdf_csiop_s pdf_csiop;
+typedef struct pdf_csicode_s pdf_csicode;
+
+struct pdf_csiop_s
+{
+	int tok;
+	int len;	/* of a string, or the number of ops for the items of an array */
+	union
+	{
+		double num;
+		int ofs;	/* of a name, string or keyword in the text */
+		fz_obj *obj;
+	} u;
+};
+
+struct pdf_csicode_s
+{
+	int refs;
+	fz_buffer *contents;	/* the key */
+	int runs;
+	int failed;
+	int size;
+	int len;
+	int cap;
+	pdf_csiop *ops;
+	int textlen;
+	int textcap;
+	char *text;
+	pdf_csicode *prev;
+	pdf_csicode *next;
+};
+
+struct pdf_codecache_s
+{
+	fz_hashtable *hash;
+	pdf_csicode *head;	/* most recently used */
+	pdf_csicode *tail;	/* least recently used */
+	int size;
+	int maxsize;
+	int hits;
+	int compiles;
+	int evictions;
+};
+
+static pdf_codecache *
+pdf_getcodecache(pdf_xref *xref)
+{
+	pdf_codecache *cache = xref->codecache;
+	if (!cache)
+	{
+		cache = fz_malloc(sizeof(pdf_codecache));
+		cache->hash = fz_newhash(64, sizeof(fz_buffer*));
+		cache->head = nil;
+		cache->tail = nil;
+		cache->size = 0;
+		cache->maxsize = PDF_CODECACHESIZE;
+		cache->hits = 0;
+		cache->compiles = 0;
+		cache->evictions = 0;
+		xref->codecache = cache;
+	}
+	return cache;
+}
+
+static void
+pdf_emptycsicode(pdf_csicode *code)
+{
+	int i;
+
+	for (i = 0; i < code->len; i++)
+		if (code->ops[i].tok == PDF_TOARRAY || code->ops[i].tok == PDF_TODICT)
+			fz_dropobj(code->ops[i].u.obj);
+	fz_free(code->ops);
+	fz_free(code->text);
+	code->len = code->cap = 0;
+	code->ops = nil;
+	code->textlen = code->textcap = 0;
+	code->text = nil;
+}
+
+static void
+pdf_dropcsicode(pdf_csicode *code)
+{
+	if (--code->refs > 0)
+		return;
+
+	/* only compiled entries keep their buffer */
+	if (code->ops)
+		fz_dropbuffer(code->contents);
+	pdf_emptycsicode(code);
+	fz_free(code);
+}
+
+static void
+pdf_unlinkcsicode(pdf_codecache *cache, pdf_csicode *code)
+{
+	if (code->prev)
+		code->prev->next = code->next;
+	else
+		cache->head = code->next;
+	if (code->next)
+		code->next->prev = code->prev;
+	else
+		cache->tail = code->prev;
+}
+
+static void
+pdf_uncachecsicode(pdf_codecache *cache, pdf_csicode *code)
+{
+	fz_hashremove(cache->hash, &code->contents);
+	pdf_unlinkcsicode(cache, code);
+	cache->size -= code->size;
+	pdf_dropcsicode(code);
+}
+
+static void
+pdf_trimcodecache(pdf_codecache *cache, int maxsize)
+{
+	while (cache->tail && cache->size > maxsize)
+	{
+		pdf_uncachecsicode(cache, cache->tail);
+		cache->evictions ++;
+	}
+}
+
+static pdf_csiop *
+pdf_addcsiop(pdf_csicode *code, int tok)
+{
+	pdf_csiop *op;
+
+	if (code->len == code->cap)
+	{
+		code->cap = code->cap * 2 + 64;
+		code->ops = fz_realloc(code->ops, code->cap, sizeof(pdf_csiop));
+	}
+
+	op = &code->ops[code->len++];
+	op->tok = tok;
+	op->len = 0;
+	op->u.obj = nil;
+	return op;
+}
+
+static int
+pdf_addcsitext(pdf_csicode *code, char *s, int len)
+{
+	int ofs;
+
+	if (code->textlen + len + 1 > code->textcap)
+	{
+		code->textcap = MAX(code->textcap * 2, code->textlen + len + 1);
+		code->text = fz_realloc(code->text, code->textcap, 1);
+	}
+
+	ofs = code->textlen;
+	memcpy(code->text + ofs, s, len);
+	code->text[ofs + len] = '\0';
+	code->textlen += len + 1;
+	return ofs;
+}
+
+/*
+ * Record the items of an array the way they are lexed and shown
+ * one by one inside a text object. Anything but a number or a
+ * string stops the run there, and is recorded as an error.
+ */
+static fz_error
+pdf_compiletextarray(pdf_csicode *code, fz_stream *file, char *buf, int buflen)
+{
+	fz_error error;
+	pdf_csiop *op;
+	double num = 0;
+	int tok, len = 0;
+
+	while (1)
+	{
+		error = pdf_lexcsi(&tok, file, buf, buflen, &len, &num);
+		if (error)
+			return fz_rethrow(error, "lexical error in content stream");
+
+		switch (tok)
+		{
+		case PDF_TCARRAY:
+			return fz_okay;
+		case PDF_TINT:
+		case PDF_TREAL:
+			op = pdf_addcsiop(code, tok);
+			op->u.num = num;
+			break;
+		case PDF_TSTRING:
+			op = pdf_addcsiop(code, tok);
+			op->len = len;
+			op->u.ofs = pdf_addcsitext(code, buf, len);
+			break;
+		case PDF_TEOF:
+			pdf_addcsiop(code, tok);
+			return fz_okay;
+		default:
+			pdf_addcsiop(code, PDF_TERROR);
+			return fz_okay;
+		}
+	}
+}
+
+static fz_error
+pdf_compilecsi(pdf_csicode *code, pdf_xref *xref, fz_stream *file, char *buf, int buflen)
+{
+	fz_error error;
+	pdf_csiop *op;
+	fz_obj *obj;
+	fz_off_t start, end;
+	double num = 0;
+	int tok, len = 0;
+	int i;
+
+	while (1)
+	{
+		error = pdf_lexcsi(&tok, file, buf, buflen, &len, &num);
+		if (error)
+			return fz_rethrow(error, "lexical error in content stream");
+
+		switch (tok)
+		{
+		case PDF_TENDSTREAM:
+		case PDF_TEOF:
+			return fz_okay;
+
+		case PDF_TOARRAY:
+			/* parsed for use as an operand, and lexed for TJ in text objects */
+			start = fz_tell(file);
+			error = pdf_parsearray(&obj, xref, file, buf, buflen);
+			if (error)
+				return fz_rethrow(error, "cannot parse array");
+			end = fz_tell(file);
+
+			i = code->len;
+			op = pdf_addcsiop(code, tok);
+			op->u.obj = obj;
+
+			fz_seek(file, start, 0);
+			error = pdf_compiletextarray(code, file, buf, buflen);
+			if (error)
+				return fz_rethrow(error, "cannot lex array");
+			fz_seek(file, end, 0);
+
+			code->ops[i].len = code->len - i - 1;
+			break;
+
+		case PDF_TODICT:
+			error = pdf_parsedict(&obj, xref, file, buf, buflen);
+			if (error)
+				return fz_rethrow(error, "cannot parse dictionary");
+			op = pdf_addcsiop(code, tok);
+			op->u.obj = obj;
+			break;
+
+		case PDF_TINT:
+		case PDF_TREAL:
+			op = pdf_addcsiop(code, tok);
+			op->u.num = num;
+			break;
+
+		case PDF_TSTRING:
+			op = pdf_addcsiop(code, tok);
+			op->len = len;
+			op->u.ofs = pdf_addcsitext(code, buf, len);
+			break;
+
+		case PDF_TKEYWORD:
+			/* inline images are read straight from the stream */
+			if (!strcmp(buf, "BI"))
+			{
+				code->failed = 1;
+				return fz_okay;
+			}
+			/* fall through */
+		case PDF_TNAME:
+			op = pdf_addcsiop(code, tok);
+			op->u.ofs = pdf_addcsitext(code, buf, strlen(buf));
+			break;
+
+		default:
+			return fz_throw("syntaxerror in content stream");
+		}
+	}
+}
+
+/*
+ * Find the cache entry for a buffer, compiling it if this is the
+ * second time it is run. The entry has no ops if the buffer is to
+ * be lexed this time. Returns nil if the cache is turned off.
+ */
+static pdf_csicode *
+pdf_findcsicode(pdf_xref *xref, fz_buffer *contents)
+{
+	pdf_codecache *cache;
+	pdf_csicode *code;
+	fz_stream *file;
+	fz_error error;
+
+	cache = pdf_getcodecache(xref);
+	if (cache->maxsize <= 0)
+		return nil;
+
+	code = fz_hashfind(cache->hash, &contents);
+	if (code)
+	{
+		if (code != cache->head)
+		{
+			pdf_unlinkcsicode(cache, code);
+			code->prev = nil;
+			code->next = cache->head;
+			cache->head->prev = code;
+			cache->head = code;
+		}
+
+		code->refs ++;
+
+		if (code->ops)
+		{
+			cache->hits ++;
+			return code;
+		}
+
+		if (code->failed || ++code->runs < 2)
+			return code;
+
+		/* one large stream should not flush everything else */
+		if (contents->len > cache->maxsize / 4)
+		{
+			code->failed = 1;
+			return code;
+		}
+
+		file = fz_openbuffer(contents);
+		error = pdf_compilecsi(code, xref, file, xref->scratch, sizeof xref->scratch);
+		fz_close(file);
+		if (error)
+			fz_catch(error, "cannot compile content stream, lexing it instead");
+		if (error || code->failed)
+		{
+			pdf_emptycsicode(code);
+			code->failed = 1;
+			return code;
+		}
+
+		/* an empty stream still needs ops to count as compiled */
+		if (!code->ops)
+			code->ops = fz_malloc(sizeof(pdf_csiop));
+
+		cache->compiles ++;
+		cache->size -= code->size;
+		code->size = sizeof(pdf_csicode) + code->cap * sizeof(pdf_csiop) + code->textcap;
+		cache->size += code->size;
+		code->contents = fz_keepbuffer(contents);
+
+		pdf_trimcodecache(cache, cache->maxsize);
+		return code;
+	}
+
+	code = fz_malloc(sizeof(pdf_csicode));
+	code->refs = 2;
+	code->contents = contents;
+	code->runs = 1;
+	code->failed = 0;
+	code->size = sizeof(pdf_csicode);
+	code->len = 0;
+	code->cap = 0;
+	code->ops = nil;
+	code->textlen = 0;
+	code->textcap = 0;
+	code->text = nil;
+	code->prev = nil;
+	code->next = cache->head;
+	if (cache->head)
+		cache->head->prev = code;
+	else
+		cache->tail = code;
+	cache->head = code;
+	cache->size += code->size;
+
+	fz_hashinsert(cache->hash, &contents, code);
+	pdf_trimcodecache(cache, cache->maxsize);
+	return code;
+}
+
+static fz_error
+pdf_runcsicode(pdf_csi *csi, fz_obj *rdb, pdf_csicode *code)
+{
+	pdf_gstate *gstate;
+	pdf_csiop *op, *item, *end;
+	fz_error error;
+
+	pdf_clearstack(csi);
+
+	end = code->ops + code->len;
+	for (op = code->ops; op < end; op++)
+	{
+		if (csi->top == nelem(csi->stack) - 1)
+			return fz_throw("stack overflow");
+
+		switch (op->tok)
+		{
+		case PDF_TOARRAY:
+			if (!csi->intext)
+			{
+				if (csi->obj)
+					fz_dropobj(csi->obj);
+				csi->obj = fz_keepobj(op->u.obj);
+				op += op->len;
+				break;
+			}
+			for (item = op + 1; item <= op + op->len; item++)
+			{
+				if (item->tok == PDF_TINT || item->tok == PDF_TREAL)
+				{
+					gstate = csi->gstate + csi->gtop;
+					pdf_showspace(csi, -item->u.num * gstate->size * 0.001f);
+				}
+				else if (item->tok == PDF_TSTRING)
+				{
+					pdf_showstring(csi, (unsigned char *)code->text + item->u.ofs, item->len);
+				}
+				else if (item->tok == PDF_TEOF)
+				{
+					csi->inarray = 1;
+					return fz_okay;
+				}
+				else
+				{
+					pdf_clearstack(csi);
+					return fz_throw("syntaxerror in array");
+				}
+			}
+			op += op->len;
+			break;
+
+		case PDF_TODICT:
+			if (csi->obj)
+				fz_dropobj(csi->obj);
+			csi->obj = fz_keepobj(op->u.obj);
+			break;
+
+		case PDF_TNAME:
+			fz_strlcpy(csi->name, code->text + op->u.ofs, sizeof(csi->name));
+			break;
+
+		case PDF_TINT:
+		case PDF_TREAL:
+			csi->stack[csi->top] = op->u.num;
+			csi->top ++;
+			break;
+
+		case PDF_TSTRING:
+			if (op->len <= sizeof(csi->string))
+			{
+				memcpy(csi->string, code->text + op->u.ofs, op->len);
+				csi->stringlen = op->len;
+			}
+			else
+			{
+				csi->obj = fz_newstring(code->text + op->u.ofs, op->len);
+			}
+			break;
+
+		case PDF_TKEYWORD:
+			error = pdf_runkeyword(csi, rdb, nil, code->text + op->u.ofs);
+			if (error)
+				return fz_rethrow(error, "cannot run keyword");
+			pdf_clearstack(csi);
+			break;
+		}
+	}
+
+	return fz_okay;
+}
+
+/*
+ * Set the number of bytes of compiled content streams to keep.
+ * Zero turns compiling off.
+ */
+void
+pdf_setcodecachesize(pdf_xref *xref, int maxsize)
+{
+	pdf_codecache *cache = pdf_getcodecache(xref);
+	cache->maxsize = MAX(maxsize, 0);
+	pdf_trimcodecache(cache, cache->maxsize);
+}
+
+void
+pdf_freecodecache(pdf_xref *xref)
+{
+	pdf_codecache *cache = xref->codecache;
+
+	if (!cache)
+		return;
+
+	while (cache->head)
+		pdf_uncachecsicode(cache, cache->head);
+	fz_freehash(cache->hash);
+	fz_free(cache);
+	xref->codecache = nil;
+}
+
+void
+pdf_debugcodecache(pdf_xref *xref)
+{
+	pdf_codecache *cache = xref->codecache;
+	pdf_csicode *code;
+	int n = 0, m = 0;
+
+	if (!cache)
+	{
+		printf("-- code cache unused --\n");
+		return;
+	}
+
+	for (code = cache->head; code; code = code->next)
+	{
+		n ++;
+		if (code->ops)
+			m ++;
+	}
+
+	printf("-- code cache --\n");
+	printf("  %d streams, %d compiled, %d of %d bytes\n", n, m, cache->size, cache->maxsize);
+	printf("  %d hits, %d compiles, %d evictions\n", cache->hits, cache->compiles, cache->evictions);
+}
+
 fz_error
 pdf_runcsibuffer(pdf_csi *csi, fz_obj *rdb, fz_buffer *contents)
 {
+	pdf_csicode *code;
 	fz_stream *file;
 	fz_error error;
+
+	/* a stream that ended inside an array leaves the next one in it */
+	code = csi->inarray ? nil : pdf_findcsicode(csi->xref, contents);
+	if (code && code->ops)
+	{
+		error = pdf_runcsicode(csi, rdb, code);
+		pdf_dropcsicode(code);
+		if (error)
+			return fz_rethrow(error, "cannot parse content stream");
+		return fz_okay;
+	}
+
 	file = fz_openbuffer(contents);
 	error = pdf_runcsifile(csi, rdb, file, csi->xref->scratch, sizeof csi->xref->scratch);
 	fz_close(file);
+
+	/* compile only what lexes cleanly, so that compiling is silent */
+	if (code)
+	{
+		if (error || csi->inarray)
+			code->failed = 1;
+		pdf_dropcsicode(code);
+	}
+
 	if (error)
 		return fz_rethrow(error, "cannot parse content stream");
 	return fz_okay;
@@ -1384,6 +1970,7 @@ pdf_runpage(pdf_xref *xref, pdf_page *page, fz_device *dev, fz_matrix ctm)
 {
 	pdf_csi *csi;
 	fz_error error;
+	fz_stream *file;
 	pdf_annot *annot;
 	int flags;
 
@@ -1392,8 +1979,11 @@ pdf_runpage(pdf_xref *xref, pdf_page *page, fz_device *dev, fz_matrix ctm)
 			fz_transformrect(ctm, page->mediabox),
 			0, 0, FZ_BNORMAL, 1);
 
+	/* page contents are run once, so they are lexed and not compiled */
 	csi = pdf_newcsi(xref, dev, ctm);
-	error = pdf_runcsibuffer(csi, page->resources, page->contents);
+	file = fz_openbuffer(page->contents);
+	error = pdf_runcsifile(csi, page->resources, file, xref->scratch, sizeof xref->scratch);
+	fz_close(file);
 	pdf_freecsi(csi);
 	if (error)
 		return fz_rethrow(error, "cannot parse page content stream");
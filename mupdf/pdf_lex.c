@@ -386,6 +386,111 @@ pdf_tokenfromkeyword(char *key)
 	return PDF_TKEYWORD;
 }
 
+static const double powten[] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+	1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+/*
+ * Convert a number in place, taking the same characters as lexnumber.
+ * With no more than 15 digits both the digits and the power of ten
+ * are exact, so the one division rounds the same way as atof does.
+ * Returns nil for longer numbers and ones that run to the end.
+ */
+static unsigned char *
+scannumber(unsigned char *p, unsigned char *ep, double *num, int *tok)
+{
+	double x = 0;
+	int neg = 0, dot = 0, digits = 0, frac = 0;
+
+	if (*p == '+' || *p == '-')
+		neg = *p++ == '-';
+
+	for (; p < ep; p++)
+	{
+		if (*p >= '0' && *p <= '9')
+		{
+			x = x * 10 + (*p - '0');
+			digits ++;
+			frac += dot;
+		}
+		else if (*p == '.' && !dot)
+			dot = 1;
+		else
+			break;
+	}
+
+	if (p == ep || digits > 15)
+		return nil;
+
+	if (frac)
+		x = x / powten[frac];
+	if (neg && digits > 0)
+		x = -x;
+
+	*num = x;
+	*tok = dot ? PDF_TREAL : PDF_TINT;
+	return p;
+}
+
+/*
+ * Nearly all of a content stream is numbers and operators. This lexes
+ * them straight out of the stream buffer, and converts the numbers as
+ * it goes instead of copying them out for atof. For any other token,
+ * and for one that runs to the end of the buffer, it returns
+ * PDF_TERROR without reading it, so that pdf_lex can take it instead.
+ */
+int
+pdf_lexcontent(fz_stream *f, char *buf, int n, double *num)
+{
+	unsigned char *p, *s;
+	int tok;
+
+	p = f->rp;
+	while (p < f->wp && iswhite(*p))
+		p++;
+	f->rp = p;
+
+	if (p == f->wp)
+		return PDF_TERROR;
+
+	switch (*p)
+	{
+	case ISNUMBER:
+		s = scannumber(p, f->wp, num, &tok);
+		if (!s)
+			return PDF_TERROR;
+		f->rp = s;
+		return tok;
+
+	case ISDELIM:
+		return PDF_TERROR;
+
+	default:
+		/* operators are one to three characters long */
+		for (s = p; s < f->wp && s - p < 4 && s - p < n - 1; s++)
+		{
+			if (iswhite(*s))
+				break;
+			switch (*s)
+			{
+			case ISDELIM:
+				goto end;
+			case '#':
+				return PDF_TERROR;
+			}
+		}
+end:
+		if (s == f->wp || s - p > 3 || s - p >= n - 1 || (s - p == 1 && *p == 'R'))
+			return PDF_TERROR;
+		memcpy(buf, p, s - p);
+		buf[s - p] = '\0';
+		f->rp = s;
+		return PDF_TKEYWORD;
+	}
+}
+
 fz_error
 pdf_lex(int *tok, fz_stream *f, char *buf, int n, int *sl)
 {
@@ -173,7 +173,7 @@ pdf_loadpage(pdf_page **pagep, pdf_xref *xref, fz_obj *dict)
 	page->links = nil;
 	page->annots = nil;
 
-	obj = fz_dictgets(dict, "MediaBox");
+	obj = pdf_lookupinherited(dict, "MediaBox");
 	bbox = fz_roundrect(pdf_torect(obj));
 	if (fz_isemptyrect(pdf_torect(obj)))
 	{
@@ -184,7 +184,7 @@ pdf_loadpage(pdf_page **pagep, pdf_xref *xref, fz_obj *dict)
 		bbox.y1 = 792;
 	}
 
-	obj = fz_dictgets(dict, "CropBox");
+	obj = pdf_lookupinherited(dict, "CropBox");
 	if (fz_isarray(obj))
 	{
 		fz_bbox cropbox = fz_roundrect(pdf_torect(obj));
@@ -199,7 +199,7 @@ pdf_loadpage(pdf_page **pagep, pdf_xref *xref, fz_obj *dict)
 	if (page->mediabox.x1 - page->mediabox.x0 < 1 || page->mediabox.y1 - page->mediabox.y0 < 1)
 		return fz_throw("invalid page size");
 
-	page->rotate = fz_toint(fz_dictgets(dict, "Rotate"));
+	page->rotate = fz_toint(pdf_lookupinherited(dict, "Rotate"));
 
 	pdf_logpage("bbox [%d %d %d %d]\n", bbox.x0, bbox.y0, bbox.x1, bbox.y1);
 	pdf_logpage("rotate %d\n", page->rotate);
@@ -211,7 +211,7 @@ pdf_loadpage(pdf_page **pagep, pdf_xref *xref, fz_obj *dict)
 		pdf_loadannots(&page->annots, xref, obj);
 	}
 
-	page->resources = fz_dictgets(dict, "Resources");
+	page->resources = pdf_lookupinherited(dict, "Resources");
 	if (page->resources)
 		fz_keepobj(page->resources);
 
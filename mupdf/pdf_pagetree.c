@@ -1,13 +1,149 @@
 #include "fitz.h"
 #include "mupdf.h"
 
-struct info
+/*
+ * The page tree is not walked when it is loaded. A page is found when
+ * it is first asked for, by going down from the root and stepping
+ * over whole subtrees by their /Count, and is remembered after that.
+ * If the counts turn out to be wrong we fall back to walking the
+ * whole tree, as we did for every file before.
+ */
+
+enum { MAXDEPTH = 64 };
+
+static fz_error pdf_loadallpages(pdf_xref *xref);
+
+static int
+pdf_ispagetreenode(fz_obj *node)
+{
+	return fz_isarray(fz_dictget(node, FZ_NAME(Kids))) && fz_isint(fz_dictget(node, FZ_NAME(Count)));
+}
+
+static fz_obj *
+pdf_getpagetreeroot(pdf_xref *xref)
+{
+	return fz_dictgets(fz_dictgets(xref->trailer, "Root"), "Pages");
+}
+
+/*
+ * Look up an attribute that a page may inherit from the nodes
+ * above it: Resources, MediaBox, CropBox or Rotate.
+ */
+fz_obj *
+pdf_lookupinherited(fz_obj *page, char *key)
 {
-	fz_obj *resources;
-	fz_obj *mediabox;
-	fz_obj *cropbox;
-	fz_obj *rotate;
-};
+	fz_obj *name, *obj;
+	int depth;
+
+	/* these are standard names, so this does not allocate */
+	name = fz_newname(key);
+	obj = nil;
+
+	for (depth = 0; fz_isdict(page) && depth < MAXDEPTH; depth++)
+	{
+		obj = fz_dictget(page, name);
+		if (obj)
+			break;
+		page = fz_dictget(page, FZ_NAME(Parent));
+	}
+
+	fz_dropobj(name);
+	return obj;
+}
+
+static void
+pdf_setpage(pdf_xref *xref, int i, fz_obj *ref)
+{
+	xref->pagerefs[i] = fz_keepobj(ref);
+	xref->pageobjs[i] = fz_keepobj(fz_resolveindirect(ref));
+}
+
+/*
+ * Find a page, counting from zero, by going down the tree
+ * and skipping the subtrees that come before it.
+ */
+static fz_error
+pdf_findpage(pdf_xref *xref, int number, fz_obj **refp)
+{
+	fz_obj *node, *kids, *kid;
+	int depth, count, i, n;
+
+	*refp = nil;
+	node = pdf_getpagetreeroot(xref);
+
+	for (depth = 0; depth < MAXDEPTH; depth++)
+	{
+		kids = fz_dictget(node, FZ_NAME(Kids));
+		n = fz_arraylen(kids);
+		kid = nil;
+
+		for (i = 0; i < n; i++)
+		{
+			kid = fz_arrayget(kids, i);
+			if (pdf_ispagetreenode(kid))
+			{
+				count = fz_toint(fz_dictget(kid, FZ_NAME(Count)));
+				if (number < count)
+					break;
+				number -= count;
+			}
+			else
+			{
+				if (number == 0)
+				{
+					*refp = kid;
+					return fz_okay;
+				}
+				number --;
+			}
+		}
+
+		if (i == n)
+			return fz_throw("page counts in page tree do not add up");
+
+		node = kid;
+	}
+
+	return fz_throw("page tree is too deep");
+}
+
+static int
+pdf_cachepage(pdf_xref *xref, int number)
+{
+	fz_error error;
+	fz_obj *ref = nil;
+
+	if (number < 1 || number > xref->pagelen)
+		return 0;
+	if (xref->pagerefs[number - 1])
+		return 1;
+
+	if (xref->indexpages)
+	{
+		ref = pdf_loadindexpage(xref, number - 1);
+		if (!ref)
+			return 0;
+		pdf_setpage(xref, number - 1, ref);
+		fz_dropobj(ref);
+		return 1;
+	}
+
+	error = pdf_findpage(xref, number - 1, &ref);
+	if (error)
+	{
+		fz_catch(error, "cannot find page %d, loading whole page tree", number);
+		error = pdf_loadallpages(xref);
+		if (error)
+		{
+			fz_catch(error, "cannot load page tree");
+			return 0;
+		}
+		return number <= xref->pagelen;
+	}
+
+	pdf_setpage(xref, number - 1, ref);
+	return 1;
+}
 
 int
 pdf_getpagecount(pdf_xref *xref)
@@ -18,7 +154,7 @@ pdf_getpagecount(pdf_xref *xref)
 fz_obj *
 pdf_getpageobject(pdf_xref *xref, int number)
 {
-	if (number > 0 && number <= xref->pagelen)
+	if (pdf_cachepage(xref, number))
 		return xref->pageobjs[number - 1];
 	return nil;
 }
@@ -26,51 +162,81 @@ pdf_getpageobject(pdf_xref *xref, int number)
 fz_obj *
 pdf_getpageref(pdf_xref *xref, int number)
 {
-	if (number > 0 && number <= xref->pagelen)
+	if (pdf_cachepage(xref, number))
 		return xref->pagerefs[number - 1];
 	return nil;
 }
 
+/*
+ * Work out the page number on the way up to the root, by adding up
+ * the pages in the subtrees to the left of the page at every level.
+ */
 int
 pdf_findpageobject(pdf_xref *xref, fz_obj *page)
 {
-	int num = fz_tonum(page);
-	int gen = fz_togen(page);
-	int i;
+	fz_obj *node, *parent, *kids, *kid;
+	int number, depth, i, n;
+
+	number = 1;
+	node = page;
+	parent = fz_dictget(node, FZ_NAME(Parent));
+
+	for (depth = 0; fz_isdict(parent) && depth < MAXDEPTH; depth++)
+	{
+		kids = fz_dictget(parent, FZ_NAME(Kids));
+		n = fz_arraylen(kids);
+		for (i = 0; i < n; i++)
+		{
+			kid = fz_arrayget(kids, i);
+			if (fz_resolveindirect(kid) == fz_resolveindirect(node))
+				break;
+			if (pdf_ispagetreenode(kid))
+				number += fz_toint(fz_dictget(kid, FZ_NAME(Count)));
+			else
+				number ++;
+		}
+		if (i == n)
+			break;
+
+		node = parent;
+		parent = fz_dictget(node, FZ_NAME(Parent));
+	}
+
+	if (fz_resolveindirect(pdf_getpageobject(xref, number)) == fz_resolveindirect(page))
+		return number;
+
+	/* the page is not where the tree says, look at every page */
+	if (xref->lazypages)
+	{
+		fz_error error = pdf_loadallpages(xref);
+		if (error)
+			fz_catch(error, "cannot load page tree");
+	}
+
 	for (i = 0; i < xref->pagelen; i++)
-		if (num == fz_tonum(xref->pagerefs[i]) && gen == fz_togen(xref->pagerefs[i]))
+	{
+		if (xref->indexpages)
+			pdf_cachepage(xref, i + 1);
+		if (xref->pageobjs[i] && xref->pageobjs[i] == fz_resolveindirect(page))
 			return i + 1;
+	}
+
 	return 0;
 }
 
 static void
-pdf_loadpagetreenode(pdf_xref *xref, fz_obj *node, struct info info)
+pdf_loadpagetreenode(pdf_xref *xref, fz_obj *node)
 {
-	fz_obj *dict, *kids, *count;
-	fz_obj *obj, *tmp;
+	fz_obj *kids, *tmp;
 	int i, n;
 
 	/* prevent infinite recursion */
 	if (fz_dictgets(node, ".seen"))
 		return;
 
-	kids = fz_dictgets(node, "Kids");
-	count = fz_dictgets(node, "Count");
-
-	if (fz_isarray(kids) && fz_isint(count))
+	if (pdf_ispagetreenode(node))
 	{
-		obj = fz_dictgets(node, "Resources");
-		if (obj)
-			info.resources = obj;
-		obj = fz_dictgets(node, "MediaBox");
-		if (obj)
-			info.mediabox = obj;
-		obj = fz_dictgets(node, "CropBox");
-		if (obj)
-			info.cropbox = obj;
-		obj = fz_dictgets(node, "Rotate");
-		if (obj)
-			info.rotate = obj;
+		kids = fz_dictget(node, FZ_NAME(Kids));
 
 		tmp = fz_newnull();
 		fz_dictputs(node, ".seen", tmp);
@@ -78,26 +244,12 @@ pdf_loadpagetreenode(pdf_xref *xref, fz_obj *node, struct info info)
 
 		n = fz_arraylen(kids);
 		for (i = 0; i < n; i++)
-		{
-			obj = fz_arrayget(kids, i);
-			pdf_loadpagetreenode(xref, obj, info);
-		}
+			pdf_loadpagetreenode(xref, fz_arrayget(kids, i));
 
 		fz_dictdels(node, ".seen");
 	}
 	else
 	{
-		dict = fz_resolveindirect(node);
-
-		if (info.resources && !fz_dictgets(dict, "Resources"))
-			fz_dictputs(dict, "Resources", info.resources);
-		if (info.mediabox && !fz_dictgets(dict, "MediaBox"))
-			fz_dictputs(dict, "MediaBox", info.mediabox);
-		if (info.cropbox && !fz_dictgets(dict, "CropBox"))
-			fz_dictputs(dict, "CropBox", info.cropbox);
-		if (info.rotate && !fz_dictgets(dict, "Rotate"))
-			fz_dictputs(dict, "Rotate", info.rotate);
-
 		if (xref->pagelen == xref->pagecap)
 		{
 			fz_warn("found more pages than expected");
@@ -106,36 +258,145 @@ pdf_loadpagetreenode(pdf_xref *xref, fz_obj *node, struct info info)
 			xref->pageobjs = fz_realloc(xref->pageobjs, xref->pagecap, sizeof(fz_obj*));
 		}
 
-		xref->pagerefs[xref->pagelen] = fz_keepobj(node);
-		xref->pageobjs[xref->pagelen] = fz_keepobj(dict);
+		pdf_setpage(xref, xref->pagelen, node);
 		xref->pagelen ++;
 	}
 }
 
-fz_error
-pdf_loadpagetree(pdf_xref *xref)
+static void
+pdf_freepagelist(pdf_xref *xref)
 {
-	struct info info;
-	fz_obj *catalog = fz_dictgets(xref->trailer, "Root");
-	fz_obj *pages = fz_dictgets(catalog, "Pages");
-	fz_obj *count = fz_dictgets(pages, "Count");
+	int i;
+
+	for (i = 0; i < xref->pagelen; i++)
+	{
+		if (xref->pagerefs[i])
+			fz_dropobj(xref->pagerefs[i]);
+		if (xref->pageobjs[i])
+			fz_dropobj(xref->pageobjs[i]);
+	}
+	fz_free(xref->pagerefs);
+	fz_free(xref->pageobjs);
+	xref->pagerefs = nil;
+	xref->pageobjs = nil;
+	xref->pagelen = 0;
+	xref->pagecap = 0;
+}
+
+/*
+ * Walk the whole tree. Pages that were already handed out
+ * are kept if they are found at the same place again.
+ */
+static fz_error
+pdf_loadallpages(pdf_xref *xref)
+{
+	fz_obj *pages = pdf_getpagetreeroot(xref);
+	fz_obj *count = fz_dictget(pages, FZ_NAME(Count));
+	fz_obj **pagerefs, **pageobjs;
+	int pagelen, i;
 
 	if (!fz_isdict(pages))
 		return fz_throw("missing page tree");
 	if (!fz_isint(count))
 		return fz_throw("missing page count");
 
-	xref->pagecap = fz_toint(count);
+	pagerefs = xref->pagerefs;
+	pageobjs = xref->pageobjs;
+	pagelen = xref->pagelen;
+
+	xref->pagecap = MAX(fz_toint(count), 0);
 	xref->pagelen = 0;
 	xref->pagerefs = fz_calloc(xref->pagecap, sizeof(fz_obj*));
 	xref->pageobjs = fz_calloc(xref->pagecap, sizeof(fz_obj*));
+	xref->lazypages = 0;
+
+	pdf_loadpagetreenode(xref, pages);
+
+	for (i = 0; i < pagelen; i++)
+	{
+		if (!pagerefs[i])
+			continue;
+		if (i < xref->pagelen && xref->pageobjs[i] == pageobjs[i])
+		{
+			fz_dropobj(xref->pagerefs[i]);
+			fz_dropobj(xref->pageobjs[i]);
+			xref->pagerefs[i] = pagerefs[i];
+			xref->pageobjs[i] = pageobjs[i];
+		}
+		else
+		{
+			fz_dropobj(pagerefs[i]);
+			fz_dropobj(pageobjs[i]);
+		}
+	}
+	fz_free(pagerefs);
+	fz_free(pageobjs);
+
+	return fz_okay;
+}
+
+/*
+ * Only the root of the tree is read here. If the counts of its
+ * children do not add up to its own, the tree is walked at once.
+ * A page list that comes from an xref index is kept as it is.
+ */
+fz_error
+pdf_loadpagetree(pdf_xref *xref)
+{
+	fz_obj *pages = pdf_getpagetreeroot(xref);
+	fz_obj *count = fz_dictget(pages, FZ_NAME(Count));
+	fz_obj *kids, *kid, *ref;
+	char *type;
+	int total, i, n;
+
+	if (!fz_isdict(pages))
+		return fz_throw("missing page tree");
+	if (!fz_isint(count))
+		return fz_throw("missing page count");
+
+	if (xref->indexpages)
+		return fz_okay;
 
-	info.resources = nil;
-	info.mediabox = nil;
-	info.cropbox = nil;
-	info.rotate = nil;
+	pdf_freepagelist(xref);
 
-	pdf_loadpagetreenode(xref, pages, info);
+	kids = fz_dictget(pages, FZ_NAME(Kids));
+	n = fz_arraylen(kids);
+	total = 0;
+	for (i = 0; i < n; i++)
+	{
+		kid = fz_arrayget(kids, i);
+		if (pdf_ispagetreenode(kid))
+			total += MAX(fz_toint(fz_dictget(kid, FZ_NAME(Count))), 0);
+		else
+			total ++;
+		if (total > xref->len)
+			break;
+	}
+
+	if (total != fz_toint(count) || total > xref->len)
+	{
+		fz_warn("page count does not match page tree");
+		return pdf_loadallpages(xref);
+	}
+
+	xref->pagecap = total;
+	xref->pagelen = total;
+	xref->pagerefs = fz_calloc(xref->pagecap, sizeof(fz_obj*));
+	xref->pageobjs = fz_calloc(xref->pagecap, sizeof(fz_obj*));
+	memset(xref->pagerefs, 0, xref->pagecap * sizeof(fz_obj*));
+	memset(xref->pageobjs, 0, xref->pagecap * sizeof(fz_obj*));
+	xref->lazypages = 1;
+
+	/* linearized files name their first page */
+	if (xref->linpage && total > 0)
+	{
+		ref = fz_newindirect(xref->linpage, 0, xref);
+		type = fz_toname(fz_dictgets(ref, "Type"));
+		/* loading it may have repaired the xref, which drops the hint */
+		if (xref->linpage && !strcmp(type, "Page"))
+			pdf_setpage(xref, 0, ref);
+		fz_dropobj(ref);
+	}
 
 	return fz_okay;
 }
@@ -113,7 +113,8 @@ pdf_parsearray(fz_obj **op, pdf_xref *xref, fz_stream *file, char *buf, int cap)
 	fz_error error = fz_okay;
 	fz_obj *ary = nil;
 	fz_obj *obj = nil;
-	int a = 0, b = 0, n = 0;
+	fz_off_t a = 0, b = 0;
+	int n = 0;
 	int tok;
 	int len;
 
@@ -132,13 +133,13 @@ pdf_parsearray(fz_obj **op, pdf_xref *xref, fz_stream *file, char *buf, int cap)
 		{
 			if (n > 0)
 			{
-				obj = fz_newint(a);
+				obj = fz_newoffset(a);
 				fz_arraypush(ary, obj);
 				fz_dropobj(obj);
 			}
 			if (n > 1)
 			{
-				obj = fz_newint(b);
+				obj = fz_newoffset(b);
 				fz_arraypush(ary, obj);
 				fz_dropobj(obj);
 			}
@@ -147,7 +148,7 @@ pdf_parsearray(fz_obj **op, pdf_xref *xref, fz_stream *file, char *buf, int cap)
 
 		if (tok == PDF_TINT && n == 2)
 		{
-			obj = fz_newint(a);
+			obj = fz_newoffset(a);
 			fz_arraypush(ary, obj);
 			fz_dropobj(obj);
 			a = b;
@@ -162,9 +163,9 @@ pdf_parsearray(fz_obj **op, pdf_xref *xref, fz_stream *file, char *buf, int cap)
 
 		case PDF_TINT:
 			if (n == 0)
-				a = atoi(buf);
+				a = strtoll(buf, 0, 10);
 			if (n == 1)
-				b = atoi(buf);
+				b = strtoll(buf, 0, 10);
 			n ++;
 			break;
 
@@ -249,7 +250,8 @@ pdf_parsedict(fz_obj **op, pdf_xref *xref, fz_stream *file, char *buf, int cap)
 	fz_obj *val = nil;
 	int tok;
 	int len;
-	int a, b;
+	fz_off_t a;
+	int b;
 
 	dict = fz_newdict(8);
 
@@ -322,8 +324,8 @@ skip:
 		case PDF_TNULL: val = fz_newnull(); break;
 
 		case PDF_TINT:
-			/* 64-bit to allow for numbers > INT_MAX and overflow */
-			a = (int) strtoll(buf, 0, 10);
+			/* 64-bit to allow for offsets > INT_MAX */
+			a = strtoll(buf, 0, 10);
 			error = pdf_lex(&tok, file, buf, cap, &len);
 			if (error)
 			{
@@ -334,7 +336,7 @@ skip:
 			if (tok == PDF_TCDICT || tok == PDF_TNAME ||
 				(tok == PDF_TKEYWORD && !strcmp(buf, "ID")))
 			{
-				val = fz_newint(a);
+				val = fz_newoffset(a);
 				fz_dictput(dict, key, val);
 				fz_dropobj(val);
 				fz_dropobj(key);
@@ -401,7 +403,7 @@ pdf_parsestmobj(fz_obj **op, pdf_xref *xref, fz_stream *file, char *buf, int cap
 	case PDF_TTRUE: *op = fz_newbool(1); break;
 	case PDF_TFALSE: *op = fz_newbool(0); break;
 	case PDF_TNULL: *op = fz_newnull(); break;
-	case PDF_TINT: *op = fz_newint(atoi(buf)); break;
+	case PDF_TINT: *op = fz_newoffset(strtoll(buf, 0, 10)); break;
 	default: return fz_throw("unknown token in object stream");
 	}
 
@@ -411,14 +413,16 @@ pdf_parsestmobj(fz_obj **op, pdf_xref *xref, fz_stream *file, char *buf, int cap
 fz_error
 pdf_parseindobj(fz_obj **op, pdf_xref *xref,
 	fz_stream *file, char *buf, int cap,
-	int *onum, int *ogen, int *ostmofs)
+	int *onum, int *ogen, fz_off_t *ostmofs)
 {
 	fz_error error = fz_okay;
 	fz_obj *obj = nil;
-	int num = 0, gen = 0, stmofs;
+	int num = 0, gen = 0;
+	fz_off_t stmofs;
 	int tok;
 	int len;
-	int a, b;
+	fz_off_t a;
+	int b;
 
 	error = pdf_lex(&tok, file, buf, cap, &len);
 	if (error)
@@ -466,13 +470,13 @@ pdf_parseindobj(fz_obj **op, pdf_xref *xref,
 	case PDF_TNULL: obj = fz_newnull(); break;
 
 	case PDF_TINT:
-		a = atoi(buf);
+		a = strtoll(buf, 0, 10);
 		error = pdf_lex(&tok, file, buf, cap, &len);
 		if (error)
 			return fz_rethrow(error, "cannot parse indirect object (%d %d R)", num, gen);
 		if (tok == PDF_TSTREAM || tok == PDF_TENDOBJ)
 		{
-			obj = fz_newint(a);
+			obj = fz_newoffset(a);
 			goto skip;
 		}
 		if (tok == PDF_TINT)
@@ -8,11 +8,8 @@ pdf_loadpattern(pdf_pattern **patp, pdf_xref *xref, fz_obj *dict)
 	pdf_pattern *pat;
 	fz_obj *obj;
 
-	if ((*patp = pdf_finditem(xref->store, pdf_droppattern, dict)))
-	{
-		pdf_keeppattern(*patp);
+	if ((*patp = pdf_claimitem(xref->store, pdf_droppattern, dict)))
 		return fz_okay;
-	}
 
 	pdf_logrsrc("load pattern (%d %d R) {\n", fz_tonum(dict), fz_togen(dict));
 
@@ -21,9 +18,6 @@ pdf_loadpattern(pdf_pattern **patp, pdf_xref *xref, fz_obj *dict)
 	pat->resources = nil;
 	pat->contents = nil;
 
-	/* Store pattern now, to avoid possible recursion if objects refer back to this one */
-	pdf_storeitem(xref->store, pdf_keeppattern, pdf_droppattern, dict, pat);
-
 	pat->ismask = fz_toint(fz_dictgets(dict, "PaintType")) == 2;
 	pat->xstep = fz_toreal(fz_dictgets(dict, "XStep"));
 	pat->ystep = fz_toreal(fz_dictgets(dict, "YStep"));
@@ -57,13 +51,16 @@ pdf_loadpattern(pdf_pattern **patp, pdf_xref *xref, fz_obj *dict)
 	error = pdf_loadstream(&pat->contents, xref, fz_tonum(dict), fz_togen(dict));
 	if (error)
 	{
-		pdf_removeitem(xref->store, pdf_droppattern, dict);
 		pdf_droppattern(pat);
 		return fz_rethrow(error, "cannot load pattern stream (%d %d R)", fz_tonum(dict), fz_togen(dict));
 	}
 
 	pdf_logrsrc("}\n");
 
+	/* Stored only when complete, so it is never found half loaded */
+	pdf_storeitem(xref->store, pdf_keeppattern, pdf_droppattern, dict, pat,
+		sizeof(pdf_pattern) + pat->contents->len);
+
 	*patp = pat;
 	return fz_okay;
 }
@@ -0,0 +1,599 @@
+#include "fitz.h"
+#include "mupdf.h"
+
+/*
+ * Read ahead the streams of a page on a background thread.
+ *
+ * The objects are resolved up front on the calling thread, since the
+ * xref and the objects in it are not safe to share. The thread only
+ * reads the raw bytes from the file source and inflates the streams
+ * that are plain flate, into buffers of its own. Its errors and
+ * warnings go to its own thread-local error chain, and it catches
+ * them itself. pdf_finishprefetch joins it and moves the decoded
+ * buffers into the stream cache, where pdf_loadstream and
+ * pdf_openstream will find them.
+ */
+
+enum { MAXDEPTH = 2, CHUNKSIZE = 64 << 10 };
+
+typedef struct pdf_prefetchjob_s pdf_prefetchjob;
+
+struct pdf_prefetchjob_s
+{
+	int num;
+	int gen;
+	fz_off_t ofs;
+	int len;
+	int inflate;
+	fz_obj *params;
+	fz_buffer *buf;
+};
+
+struct pdf_prefetch_s
+{
+	pdf_xref *xref;
+	fz_source *src;
+	fz_thread *thread;
+	int limit;
+	int len;
+	int cap;
+	pdf_prefetchjob *jobs;
+};
+
+static int
+pdf_isplainflate(fz_obj *dict)
+{
+	fz_obj *filter = fz_dictgetsa(dict, "Filter", "F");
+	if (fz_isarray(filter) && fz_arraylen(filter) == 1)
+		filter = fz_arrayget(filter, 0);
+	return fz_isname(filter) &&
+		(!strcmp(fz_toname(filter), "FlateDecode") || !strcmp(fz_toname(filter), "Fl"));
+}
+
+/*
+ * Copy the predictor parameters into a direct dictionary, so
+ * that the thread can look at them without touching the xref.
+ */
+static fz_obj *
+pdf_copypredictparams(fz_obj *params)
+{
+	static char *keys[] = { "Predictor", "Columns", "Colors", "BitsPerComponent" };
+	fz_obj *copy, *val;
+	int i;
+
+	if (fz_isarray(params))
+		params = fz_arrayget(params, 0);
+	if (fz_toint(fz_dictgets(params, "Predictor")) <= 1)
+		return nil;
+
+	copy = fz_newdict(4);
+	for (i = 0; i < nelem(keys); i++)
+	{
+		val = fz_dictgets(params, keys[i]);
+		if (val)
+		{
+			val = fz_newint(fz_toint(val));
+			fz_dictputs(copy, keys[i], val);
+			fz_dropobj(val);
+		}
+	}
+	return copy;
+}
+
+static void
+pdf_prefetchstream(pdf_prefetch *pf, fz_obj *ref)
+{
+	pdf_xref *xref = pf->xref;
+	pdf_prefetchjob *job;
+	fz_obj *dict;
+	int num, gen, i;
+
+	if (!fz_isindirect(ref))
+		return;
+
+	num = fz_tonum(ref);
+	gen = fz_togen(ref);
+
+	for (i = 0; i < pf->len; i++)
+		if (pf->jobs[i].num == num)
+			return;
+
+	if (pdf_iscachedstream(xref, num, gen) || !pdf_isstream(xref, num, gen))
+		return;
+
+	if (pf->len == pf->cap)
+	{
+		pf->cap = pf->cap * 2 + 8;
+		pf->jobs = fz_realloc(pf->jobs, pf->cap, sizeof(pdf_prefetchjob));
+	}
+
+	dict = xref->table[num].obj;
+
+	job = &pf->jobs[pf->len++];
+	job->num = num;
+	job->gen = gen;
+	job->ofs = xref->table[num].stmofs;
+	job->len = MAX(fz_toint(fz_dictgets(dict, "Length")), 0);
+	job->inflate = !xref->crypt && pf->limit > 0 && pdf_isplainflate(dict);
+	job->params = nil;
+	job->buf = nil;
+
+	/* images too big for the cache are only read */
+	if (!strcmp(fz_toname(fz_dictgets(dict, "Subtype")), "Image"))
+	{
+		int w = fz_toint(fz_dictgets(dict, "Width"));
+		int h = fz_toint(fz_dictgets(dict, "Height"));
+		if (w <= 0 || h <= 0 || w > pf->limit / h)
+			job->inflate = 0;
+	}
+
+	if (job->inflate)
+		job->params = pdf_copypredictparams(fz_dictgetsa(dict, "DecodeParms", "DP"));
+}
+
+static void
+pdf_prefetchfont(pdf_prefetch *pf, fz_obj *font)
+{
+	fz_obj *desc;
+
+	if (pdf_finditem(pf->xref->store, pdf_dropfont, font))
+		return;
+
+	desc = fz_dictgets(font, "FontDescriptor");
+	if (!desc)
+		desc = fz_dictgets(fz_arrayget(fz_dictgets(font, "DescendantFonts"), 0), "FontDescriptor");
+
+	pdf_prefetchstream(pf, fz_dictgets(desc, "FontFile"));
+	pdf_prefetchstream(pf, fz_dictgets(desc, "FontFile2"));
+	pdf_prefetchstream(pf, fz_dictgets(desc, "FontFile3"));
+}
+
+static void
+pdf_prefetchresources(pdf_prefetch *pf, fz_obj *rdb, int depth)
+{
+	pdf_xref *xref = pf->xref;
+	fz_obj *dict, *obj;
+	int i;
+
+	dict = fz_dictgets(rdb, "Font");
+	for (i = 0; i < fz_dictlen(dict); i++)
+		pdf_prefetchfont(pf, fz_dictgetval(dict, i));
+
+	dict = fz_dictgets(rdb, "XObject");
+	for (i = 0; i < fz_dictlen(dict); i++)
+	{
+		obj = fz_dictgetval(dict, i);
+
+		if (pdf_finditem(xref->store, fz_droppixmap, obj) ||
+			pdf_finditem(xref->store, pdf_dropxobject, obj))
+			continue;
+
+		pdf_prefetchstream(pf, obj);
+		pdf_prefetchstream(pf, fz_dictgets(obj, "SMask"));
+
+		if (depth < MAXDEPTH && !strcmp(fz_toname(fz_dictgets(obj, "Subtype")), "Form"))
+			pdf_prefetchresources(pf, fz_dictgets(obj, "Resources"), depth + 1);
+	}
+}
+
+static void
+pdf_prefetchthread(void *arg)
+{
+	pdf_prefetch *pf = arg;
+	pdf_prefetchjob *job;
+	unsigned char scratch[CHUNKSIZE];
+	fz_buffer *raw;
+	fz_error error;
+	int i, n, len;
+
+	for (i = 0; i < pf->len; i++)
+	{
+		job = &pf->jobs[i];
+
+		/* streams we do not decode are only read to bring them into memory */
+		if (!job->inflate)
+		{
+			for (len = 0; len < job->len; len += n)
+			{
+				n = pf->src->readat(pf->src, job->ofs + len, scratch, MIN(job->len - len, CHUNKSIZE));
+				if (n <= 0)
+					break;
+			}
+			continue;
+		}
+
+		raw = fz_newbuffer(MAX(job->len, 1));
+		while (raw->len < job->len)
+		{
+			n = pf->src->readat(pf->src, job->ofs + raw->len, raw->data + raw->len, job->len - raw->len);
+			if (n <= 0)
+				break;
+			raw->len += n;
+		}
+
+		error = fz_inflate(&job->buf, raw->data, raw->len, job->len * 3);
+		if (error)
+		{
+			fz_catch(error, "leaving stream (%d %d R) to be read later", job->num, job->gen);
+			job->buf = nil;
+		}
+		else if (job->params)
+			fz_predictbuffer(job->buf, job->params);
+
+		fz_dropbuffer(raw);
+	}
+
+	fz_flushwarnings();
+}
+
+/*
+ * Start reading the streams of a page in the background. Returns nil
+ * if the file cannot be read from another thread or there is nothing
+ * to read. The xref can be used as usual until pdf_finishprefetch.
+ */
+pdf_prefetch *
+pdf_prefetchpage(pdf_xref *xref, fz_obj *page)
+{
+	pdf_prefetch *pf;
+	fz_obj *contents;
+	fz_source *src;
+	int i;
+
+	src = fz_streamsource(xref->file);
+	if (!src)
+		return nil;
+
+	pf = fz_malloc(sizeof(pdf_prefetch));
+	pf->xref = xref;
+	pf->src = fz_keepsource(src);
+	pf->thread = nil;
+	pf->limit = pdf_streamcachelimit(xref);
+	pf->len = 0;
+	pf->cap = 0;
+	pf->jobs = nil;
+
+	contents = fz_dictgets(page, "Contents");
+	if (fz_isarray(contents))
+		for (i = 0; i < fz_arraylen(contents); i++)
+			pdf_prefetchstream(pf, fz_arrayget(contents, i));
+	else
+		pdf_prefetchstream(pf, contents);
+
+	pdf_prefetchresources(pf, pdf_lookupinherited(page, "Resources"), 0);
+
+	if (pf->len == 0)
+	{
+		pdf_finishprefetch(pf);
+		return nil;
+	}
+
+	pdf_logpage("prefetch %d streams\n", pf->len);
+
+	for (i = 0; i < pf->len; i++)
+		fz_prefetchsource(src, pf->jobs[i].ofs, pf->jobs[i].len);
+
+	pf->thread = fz_newthread(pdf_prefetchthread, pf);
+	return pf;
+}
+
+void
+pdf_finishprefetch(pdf_prefetch *pf)
+{
+	pdf_prefetchjob *job;
+	int i;
+
+	if (!pf)
+		return;
+
+	if (pf->thread)
+		fz_jointhread(pf->thread);
+
+	for (i = 0; i < pf->len; i++)
+	{
+		job = &pf->jobs[i];
+		if (job->buf)
+		{
+			pdf_cachestream(pf->xref, job->num, job->gen, job->buf);
+			fz_dropbuffer(job->buf);
+		}
+		if (job->params)
+			fz_dropobj(job->params);
+	}
+
+	fz_dropsource(pf->src);
+	fz_free(pf->jobs);
+	fz_free(pf);
+}
+
+/*
+ * Decode and parse all the object streams of a document on a pool of
+ * threads, for tools that are about to load every object anyway.
+ *
+ * As with reading a page ahead, only the calling thread touches the
+ * xref. It reads the raw bytes of each object stream up front. The
+ * threads inflate them and parse the objects into arrays of their own,
+ * and the objects are put into xref->table once the threads are joined.
+ * Each thread catches the errors of the streams it gives up on, in its
+ * own thread-local error chain.
+ * Object streams with other filters, and those of encrypted files, are
+ * left to be loaded when they are asked for.
+ */
+
+enum { LEXSIZE = 64 << 10 };
+
+typedef struct pdf_objstmjob_s pdf_objstmjob;
+typedef struct pdf_warmup_s pdf_warmup;
+
+struct pdf_objstmjob_s
+{
+	int num;
+	int count;
+	int first;
+	int inflate;
+	fz_obj *params;
+	fz_buffer *raw;
+	fz_buffer *buf;
+	int len;	/* of objs, once all have been parsed */
+	int *nums;
+	fz_obj **objs;
+};
+
+struct pdf_warmup_s
+{
+	pdf_xref *xref;
+	fz_mutex *lock;
+	int next;
+	int len;
+	pdf_objstmjob *jobs;
+};
+
+static fz_error
+pdf_parseobjstmjob(pdf_xref *xref, pdf_objstmjob *job, char *buf, int cap)
+{
+	fz_error error;
+	fz_stream *stm;
+	int *ofsbuf;
+	int i, n, tok;
+
+	if (job->inflate)
+	{
+		error = fz_inflate(&job->buf, job->raw->data, job->raw->len, job->raw->len * 3);
+		if (error)
+			return fz_rethrow(error, "cannot inflate object stream (%d 0 R)", job->num);
+		if (job->params)
+			fz_predictbuffer(job->buf, job->params);
+	}
+
+	ofsbuf = fz_calloc(job->count, sizeof(int));
+	stm = fz_openbuffer(job->buf);
+
+	for (i = 0; i < job->count; i++)
+	{
+		error = pdf_lex(&tok, stm, buf, cap, &n);
+		if (error || tok != PDF_TINT)
+			goto corrupt;
+		job->nums[i] = atoi(buf);
+
+		error = pdf_lex(&tok, stm, buf, cap, &n);
+		if (error || tok != PDF_TINT)
+			goto corrupt;
+		ofsbuf[i] = atoi(buf);
+	}
+
+	for (i = 0; i < job->count; i++)
+	{
+		fz_seek(stm, job->first + (fz_off_t)ofsbuf[i], 0);
+
+		error = pdf_parsestmobj(&job->objs[i], xref, stm, buf, cap);
+		if (error)
+		{
+			fz_close(stm);
+			fz_free(ofsbuf);
+			return fz_rethrow(error, "cannot parse object %d in stream (%d 0 R)", i, job->num);
+		}
+	}
+
+	/* like pdf_loadobjstm, a stream that does not parse is loaded in full later */
+	job->len = job->count;
+
+	fz_close(stm);
+	fz_free(ofsbuf);
+	return fz_okay;
+
+corrupt:
+	fz_close(stm);
+	fz_free(ofsbuf);
+	if (error)
+		return fz_rethrow(error, "corrupt object stream (%d 0 R)", job->num);
+	return fz_throw("corrupt object stream (%d 0 R)", job->num);
+}
+
+static void
+pdf_warmupthread(void *arg)
+{
+	pdf_warmup *wu = arg;
+	pdf_objstmjob *job;
+	char buf[LEXSIZE];
+	fz_error error;
+
+	while (1)
+	{
+		fz_lockmutex(wu->lock);
+		job = wu->next < wu->len ? &wu->jobs[wu->next++] : nil;
+		fz_unlockmutex(wu->lock);
+
+		if (!job)
+		{
+			fz_flushwarnings();
+			return;
+		}
+
+		error = pdf_parseobjstmjob(wu->xref, job, buf, sizeof buf);
+		if (error)
+			fz_catch(error, "leaving object stream (%d 0 R) to be loaded later", job->num);
+	}
+}
+
+/*
+ * Set up the job for one object stream. Returns 0 if the object
+ * stream is to be left to pdf_loadobjstm.
+ */
+static int
+pdf_newobjstmjob(pdf_xref *xref, pdf_objstmjob *job, int num)
+{
+	fz_error error;
+	fz_obj *dict;
+	int i;
+
+	error = pdf_loadobject(&dict, xref, num, 0);
+	if (error)
+	{
+		fz_catch(error, "cannot load object stream object (%d 0 R)", num);
+		return 0;
+	}
+
+	job->num = num;
+	job->count = fz_toint(fz_dictgets(dict, "N"));
+	job->first = fz_toint(fz_dictgets(dict, "First"));
+	job->inflate = pdf_isplainflate(dict);
+	job->params = nil;
+	job->raw = nil;
+	job->buf = nil;
+	job->len = 0;
+
+	if (job->count <= 0 || job->first < 0 || xref->crypt ||
+		(!job->inflate && fz_dictgetsa(dict, "Filter", "F")))
+	{
+		fz_dropobj(dict);
+		return 0;
+	}
+
+	if (job->inflate)
+		job->params = pdf_copypredictparams(fz_dictgetsa(dict, "DecodeParms", "DP"));
+	fz_dropobj(dict);
+
+	/* the raw buffer may be a view of the file, so it is dropped here too */
+	error = pdf_loadrawstream(&job->raw, xref, num, 0);
+	if (error)
+	{
+		fz_catch(error, "cannot read object stream (%d 0 R)", num);
+		if (job->params)
+			fz_dropobj(job->params);
+		return 0;
+	}
+
+	if (!job->inflate)
+		job->buf = fz_keepbuffer(job->raw);
+
+	job->nums = fz_calloc(job->count, sizeof(int));
+	job->objs = fz_calloc(job->count, sizeof(fz_obj*));
+	for (i = 0; i < job->count; i++)
+		job->objs[i] = nil;
+
+	return 1;
+}
+
+static void
+pdf_finishobjstmjob(pdf_xref *xref, pdf_objstmjob *job)
+{
+	pdf_xrefentry *x;
+	int i, num;
+
+	for (i = 0; i < job->len; i++)
+	{
+		num = job->nums[i];
+		x = num >= 1 && num < xref->len ? &xref->table[num] : nil;
+
+		/* objects that are already loaded may have been updated */
+		if (x && x->type == 'o' && x->ofs == job->num && !x->obj)
+			x->obj = job->objs[i];
+		else
+			fz_dropobj(job->objs[i]);
+	}
+
+	for (; i < job->count; i++)
+		if (job->objs[i])
+			fz_dropobj(job->objs[i]);
+
+	fz_dropbuffer(job->raw);
+	if (job->buf)
+		fz_dropbuffer(job->buf);
+	if (job->params)
+		fz_dropobj(job->params);
+	fz_free(job->nums);
+	fz_free(job->objs);
+}
+
+/*
+ * Load every object that lives in an object stream, using all the
+ * processors. Object streams that cannot be decoded here are left
+ * to be loaded as usual when their objects are asked for.
+ */
+fz_error
+pdf_warmupxref(pdf_xref *xref)
+{
+	fz_error error;
+	pdf_warmup wu;
+	fz_thread **threads;
+	char *seen;
+	int cap, num, stm, i, n;
+
+	error = pdf_loadlazyxref(xref);
+	if (error)
+		return fz_rethrow(error, "cannot load xref");
+
+	wu.xref = xref;
+	wu.next = 0;
+	wu.len = 0;
+	wu.jobs = nil;
+	cap = 0;
+
+	seen = fz_malloc(xref->len);
+	memset(seen, 0, xref->len);
+
+	for (num = 0; num < xref->len; num++)
+	{
+		if (xref->table[num].type != 'o' || xref->table[num].obj)
+			continue;
+
+		stm = xref->table[num].ofs;
+		if (stm < 1 || stm >= xref->len || seen[stm])
+			continue;
+		seen[stm] = 1;
+
+		if (wu.len == cap)
+		{
+			cap = cap * 2 + 8;
+			wu.jobs = fz_realloc(wu.jobs, cap, sizeof(pdf_objstmjob));
+		}
+
+		if (pdf_newobjstmjob(xref, &wu.jobs[wu.len], stm))
+			wu.len ++;
+	}
+
+	fz_free(seen);
+
+	if (wu.len == 0)
+	{
+		fz_free(wu.jobs);
+		return fz_okay;
+	}
+
+	n = MIN(fz_cpucount(), wu.len);
+	pdf_logxref("warmup %d object streams on %d threads\n", wu.len, n);
+
+	wu.lock = fz_newmutex();
+	threads = fz_calloc(n, sizeof(fz_thread*));
+	for (i = 0; i < n; i++)
+		threads[i] = fz_newthread(pdf_warmupthread, &wu);
+	for (i = 0; i < n; i++)
+		fz_jointhread(threads[i]);
+	fz_free(threads);
+	fz_freemutex(wu.lock);
+
+	for (i = 0; i < wu.len; i++)
+		pdf_finishobjstmjob(xref, &wu.jobs[i]);
+	fz_free(wu.jobs);
+
+	return fz_okay;
+}
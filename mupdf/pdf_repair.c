@@ -7,13 +7,176 @@ struct entry
 {
 	int num;
 	int gen;
-	int ofs;
-	int stmofs;
+	fz_off_t ofs;
+	fz_off_t stmofs;
 	int stmlen;
 };
 
+/*
+ * When the file is in memory the repair scanner searches the bytes
+ * with memchr, which the C library vectorises, instead of lexing every
+ * token through the stream buffer. Runs of binary data between objects
+ * and streams with a bad Length are then passed over at close to
+ * memory speed.
+ */
+
+static inline int
+isrepairwhite(int c)
+{
+	return c == '\000' || c == '\011' || c == '\012' ||
+		c == '\014' || c == '\015' || c == '\040';
+}
+
+static inline int
+isrepairdelim(int c)
+{
+	return c == '(' || c == ')' || c == '<' || c == '>' || c == '[' ||
+		c == ']' || c == '{' || c == '}' || c == '/' || c == '%';
+}
+
+/*
+ * Find the first "endstream" at or after ofs. Returns the length of the
+ * data if there is none.
+ */
+static fz_off_t
+pdf_findendstream(fz_buffer *mem, fz_off_t ofs)
+{
+	unsigned char *p = mem->data + ofs;
+	unsigned char *end = mem->data + mem->len;
+
+	while (end - p >= 9)
+	{
+		p = memchr(p, 'e', end - p - 8);
+		if (!p)
+			break;
+		if (!memcmp(p, "endstream", 9))
+			return p - mem->data;
+		p++;
+	}
+
+	return mem->len;
+}
+
+/*
+ * Read the digits that end at p backwards. Returns the first
+ * digit, or nil if there are none or too many.
+ */
+static unsigned char *
+pdf_repairdigits(unsigned char *data, unsigned char *p, int maxdigits, int *valp)
+{
+	unsigned char *q = p;
+	int val;
+
+	while (q >= data && *q >= '0' && *q <= '9' && p - q < maxdigits)
+		q--;
+	if (q == p || (q >= data && *q >= '0' && *q <= '9'))
+		return nil;
+
+	for (val = 0, p = q + 1; *p >= '0' && *p <= '9'; p++)
+		val = val * 10 + *p - '0';
+	*valp = val;
+	return q + 1;
+}
+
+/*
+ * Check for "num gen obj" with the 'j' of obj at p. Returns the
+ * start of num, or nil.
+ */
+static unsigned char *
+pdf_repairobjheader(fz_buffer *mem, unsigned char *p, int *nump, int *genp)
+{
+	unsigned char *data = mem->data;
+	unsigned char *end = data + mem->len;
+	unsigned char *q;
+
+	if (p - data < 6 || p[-1] != 'b' || p[-2] != 'o')
+		return nil;
+	if (p + 1 < end && !isrepairwhite(p[1]) && !isrepairdelim(p[1]))
+		return nil;
+
+	q = p - 3;
+	if (!isrepairwhite(*q))
+		return nil;
+	while (q > data && isrepairwhite(*q))
+		q--;
+	q = pdf_repairdigits(data, q, 5, genp);
+	if (!q || q == data || !isrepairwhite(q[-1]))
+		return nil;
+
+	q--;
+	while (q > data && isrepairwhite(*q))
+		q--;
+	q = pdf_repairdigits(data, q, 9, nump);
+	if (!q)
+		return nil;
+	if (q > data && !isrepairwhite(q[-1]) && !isrepairdelim(q[-1]))
+		return nil;
+
+	return q;
+}
+
+/*
+ * Find the next "num gen obj" or "trailer <<" after the position of
+ * the file, and leave the file just after it. Returns PDF_TOBJ,
+ * PDF_TODICT or PDF_TEOF like the lexer would.
+ */
+static int
+pdf_repairnext(fz_stream *file, fz_buffer *mem, int *nump, int *genp, fz_off_t *ofsp)
+{
+	unsigned char *data = mem->data;
+	unsigned char *end = data + mem->len;
+	unsigned char *s, *p, *t, *obj;
+
+	s = data + fz_tell(file);
+	if (s > end)
+		s = end;
+
+	obj = nil;
+	for (p = s; p < end; p++)
+	{
+		p = memchr(p, 'j', end - p);
+		if (!p)
+			break;
+		obj = pdf_repairobjheader(mem, p, nump, genp);
+		if (obj)
+			break;
+	}
+	if (!obj)
+		p = end;
+
+	/* a trailer before the next object */
+	for (t = s; p - t >= 7; t++)
+	{
+		t = memchr(t, 't', p - t - 6);
+		if (!t)
+			break;
+		if (!memcmp(t, "trailer", 7))
+		{
+			t += 7;
+			while (t < end && isrepairwhite(*t))
+				t++;
+			if (end - t >= 2 && t[0] == '<' && t[1] == '<')
+			{
+				fz_seek(file, t + 2 - data, 0);
+				return PDF_TODICT;
+			}
+			t--;
+		}
+	}
+
+	if (!obj)
+	{
+		fz_seek(file, mem->len, 0);
+		return PDF_TEOF;
+	}
+
+	*ofsp = obj - data;
+	fz_seek(file, p + 1 - data, 0);
+	return PDF_TOBJ;
+}
+
 static fz_error
-fz_repairobj(fz_stream *file, char *buf, int cap, int *stmofsp, int *stmlenp, fz_obj **encrypt, fz_obj **id)
+fz_repairobj(fz_stream *file, fz_buffer *mem, char *buf, int cap, fz_off_t *stmofsp, int *stmlenp, fz_obj **encrypt, fz_obj **id)
 {
 	fz_error error;
 	int tok;
@@ -88,7 +251,8 @@ fz_repairobj(fz_stream *file, char *buf, int cap, int *stmofsp, int *stmlenp, fz
 		if (*stmofsp < 0)
 			return fz_throw("cannot seek in file");
 
-		if (stmlen > 0)
+		/* skip the data if Length is plausible */
+		if (stmlen > 0 && (!mem || *stmofsp + stmlen <= mem->len))
 		{
 			fz_seek(file, *stmofsp + stmlen, 0);
 			error = pdf_lex(&tok, file, buf, cap, &len);
@@ -99,6 +263,22 @@ fz_repairobj(fz_stream *file, char *buf, int cap, int *stmofsp, int *stmlenp, fz
 			fz_seek(file, *stmofsp, 0);
 		}
 
+		if (mem)
+		{
+			fz_off_t endofs = pdf_findendstream(mem, *stmofsp);
+			if (endofs < mem->len)
+			{
+				*stmlenp = endofs - *stmofsp;
+				fz_seek(file, endofs + 9, 0);
+			}
+			else
+			{
+				*stmlenp = mem->len - *stmofsp - 9;
+				fz_seek(file, mem->len, 0);
+			}
+			goto atobjend;
+		}
+
 		n = fz_read(file, (unsigned char *) buf, 9);
 		if (n < 0)
 			return fz_rethrow(n, "cannot read from file");
@@ -160,11 +340,14 @@ pdf_repairobjstm(pdf_xref *xref, int num, int gen)
 		if (n >= xref->len)
 			pdf_resizexref(xref, n + 1);
 
-		xref->table[n].ofs = num;
-		xref->table[n].gen = i;
-		xref->table[n].stmofs = 0;
-		xref->table[n].obj = nil;
-		xref->table[n].type = 'o';
+		/* objects loaded before a repair after open may be in use */
+		if (!xref->table[n].obj)
+		{
+			xref->table[n].ofs = num;
+			xref->table[n].gen = i;
+			xref->table[n].stmofs = 0;
+			xref->table[n].type = 'o';
+		}
 
 		error = pdf_lex(&tok, stm, buf, sizeof buf, &n);
 		if (error || tok != PDF_TINT)
@@ -184,6 +367,7 @@ pdf_repairxref(pdf_xref *xref, char *buf, int bufsize)
 	fz_error error;
 	fz_obj *dict, *obj;
 	fz_obj *length;
+	fz_buffer *mem;
 
 	fz_obj *encrypt = nil;
 	fz_obj *id = nil;
@@ -197,8 +381,9 @@ pdf_repairxref(pdf_xref *xref, char *buf, int bufsize)
 
 	int num = 0;
 	int gen = 0;
-	int tmpofs, numofs = 0, genofs = 0;
-	int stmlen, stmofs = 0;
+	fz_off_t tmpofs, numofs = 0, genofs = 0;
+	fz_off_t stmofs = 0;
+	int stmlen;
 	int tok;
 	int next;
 	int i, n;
@@ -229,33 +414,42 @@ pdf_repairxref(pdf_xref *xref, char *buf, int bufsize)
 		}
 	}
 
+	mem = fz_streambuffer(xref->file);
+
 	while (1)
 	{
-		tmpofs = fz_tell(xref->file);
-		if (tmpofs < 0)
+		if (mem)
 		{
-			error = fz_throw("cannot tell in file");
-			goto cleanup;
+			tok = pdf_repairnext(xref->file, mem, &num, &gen, &numofs);
 		}
-
-		error = pdf_lex(&tok, xref->file, buf, bufsize, &n);
-		if (error)
+		else
 		{
-			fz_catch(error, "ignoring the rest of the file");
-			break;
-		}
+			tmpofs = fz_tell(xref->file);
+			if (tmpofs < 0)
+			{
+				error = fz_throw("cannot tell in file");
+				goto cleanup;
+			}
 
-		if (tok == PDF_TINT)
-		{
-			numofs = genofs;
-			num = gen;
-			genofs = tmpofs;
-			gen = atoi(buf);
+			error = pdf_lex(&tok, xref->file, buf, bufsize, &n);
+			if (error)
+			{
+				fz_catch(error, "ignoring the rest of the file");
+				break;
+			}
+
+			if (tok == PDF_TINT)
+			{
+				numofs = genofs;
+				num = gen;
+				genofs = tmpofs;
+				gen = atoi(buf);
+			}
 		}
 
 		if (tok == PDF_TOBJ)
 		{
-			error = fz_repairobj(xref->file, buf, bufsize, &stmofs, &stmlen, &encrypt, &id);
+			error = fz_repairobj(xref->file, mem, buf, bufsize, &stmofs, &stmlen, &encrypt, &id);
 			if (error)
 			{
 				error = fz_rethrow(error, "cannot parse object (%d %d R)", num, gen);
@@ -333,9 +527,10 @@ pdf_repairxref(pdf_xref *xref, char *buf, int bufsize)
 			break;
 	}
 
-	/* make xref reasonable */
+	/* make xref reasonable; a table repaired after open is not shrunk */
 
-	pdf_resizexref(xref, maxnum + 1);
+	if (maxnum + 1 > xref->len)
+		pdf_resizexref(xref, maxnum + 1);
 
 	for (i = 0; i < listlen; i++)
 	{
@@ -362,6 +557,9 @@ pdf_repairxref(pdf_xref *xref, char *buf, int bufsize)
 			fz_dictputs(dict, "Length", length);
 			fz_dropobj(length);
 
+			/* the corrected length would be lost if it were parsed again */
+			xref->table[list[i].num].age = -1;
+
 			fz_dropobj(dict);
 		}
 
@@ -445,6 +643,7 @@ cleanup:
 fz_error
 pdf_repairobjstms(pdf_xref *xref)
 {
+	fz_error error;
 	fz_obj *dict;
 	int i;
 
@@ -452,7 +651,12 @@ pdf_repairobjstms(pdf_xref *xref)
 	{
 		if (xref->table[i].stmofs)
 		{
-			pdf_loadobject(&dict, xref, i, 0);
+			error = pdf_loadobject(&dict, xref, i, 0);
+			if (error)
+			{
+				fz_catch(error, "ignoring broken object (%d 0 R)", i);
+				continue;
+			}
 			if (!strcmp(fz_toname(fz_dictgets(dict, "Type")), "ObjStm"))
 				pdf_repairobjstm(xref, i, 0);
 			fz_dropobj(dict);
@@ -1113,11 +1113,8 @@ pdf_loadshading(fz_shade **shadep, pdf_xref *xref, fz_obj *dict)
 	fz_matrix mat;
 	fz_obj *obj;
 
-	if ((*shadep = pdf_finditem(xref->store, fz_dropshade, dict)))
-	{
-		fz_keepshade(*shadep);
+	if ((*shadep = pdf_claimitem(xref->store, fz_dropshade, dict)))
 		return fz_okay;
-	}
 
 	/* Type 2 pattern dictionary */
 	if (fz_dictgets(dict, "PatternType"))
@@ -1164,7 +1161,8 @@ pdf_loadshading(fz_shade **shadep, pdf_xref *xref, fz_obj *dict)
 			return fz_rethrow(error, "cannot load shading dictionary (%d %d R)", fz_tonum(dict), fz_togen(dict));
 	}
 
-	pdf_storeitem(xref->store, fz_keepshade, fz_dropshade, dict, *shadep);
+	pdf_storeitem(xref->store, fz_keepshade, fz_dropshade, dict, *shadep,
+		sizeof(fz_shade) + (*shadep)->meshcap * sizeof(float));
 
 	return fz_okay;
 }
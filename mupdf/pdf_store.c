@@ -1,17 +1,46 @@
 #include "fitz.h"
 #include "mupdf.h"
 
+/*
+ * The resource store keeps the resources loaded from a document, keyed
+ * on the objects they were loaded from, within a budget of bytes. The
+ * loaders give the size of each item.
+ *
+ * When the store is over budget it drops items in GreedyDual-Size
+ * order. Every item costs the same to load again, so its credit is the
+ * clock of the store plus one over its size, and the item with the
+ * least credit goes first. The clock moves up to the credit of each
+ * item that is dropped, and an item that is found again has its credit
+ * renewed. Large items that are not used again go first, and small
+ * ones stay until they have not been used for a long time.
+ *
+ * All items are found through one hash table. Indirect keys are hashed
+ * on their object number. Other keys are hashed on their contents, and
+ * the items that share a hash are chained and told apart with
+ * fz_objcmp.
+ *
+ * The store is not locked. A document and its store are used by one
+ * thread at a time.
+ */
+
 typedef struct pdf_item_s pdf_item;
 
 struct pdf_item_s
 {
+	void *keepfunc;
 	void *dropfunc;
 	fz_obj *key;
 	void *val;
+	int size;
 	int age;
+	double credit;
+	pdf_storestats *stats;
+	pdf_item *chain;	/* with the same hash key */
+	pdf_item *prev;
 	pdf_item *next;
 };
 
+/* gen is -1 and num the hash of the contents for direct keys */
 struct refkey
 {
 	void *dropfunc;
@@ -19,58 +48,242 @@ struct refkey
 	int gen;
 };
 
+enum { MAXSTATS = 16 };
+
 struct pdf_store_s
 {
-	fz_hashtable *hash;	/* hash for num/gen keys */
-	pdf_item *root;		/* linked list for everything else */
+	fz_hashtable *hash;
+	pdf_item *head;	/* newest first */
+	int size;
+	int maxsize;
+	double clock;
+	int nstats;
+	pdf_storestats stats[MAXSTATS];
 };
 
+static void
+pdf_makerefkey(struct refkey *refkey, void *dropfunc, fz_obj *key)
+{
+	memset(refkey, 0, sizeof(struct refkey));
+	refkey->dropfunc = dropfunc;
+	if (fz_isindirect(key))
+	{
+		refkey->num = fz_tonum(key);
+		refkey->gen = fz_togen(key);
+	}
+	else
+	{
+		refkey->num = fz_objhash(key);
+		refkey->gen = -1;
+	}
+}
+
+static char *
+pdf_storetypename(void *dropfunc)
+{
+	if (dropfunc == (void*)fz_droppixmap) return "image";
+	if (dropfunc == (void*)pdf_dropfont) return "font";
+	if (dropfunc == (void*)pdf_dropcmap) return "cmap";
+	if (dropfunc == (void*)fz_dropshade) return "shade";
+	if (dropfunc == (void*)pdf_droppattern) return "pattern";
+	if (dropfunc == (void*)pdf_dropfunction) return "function";
+	if (dropfunc == (void*)pdf_dropxobject) return "xobject";
+	if (dropfunc == (void*)fz_dropcolorspace) return "colorspace";
+	return "other";
+}
+
+static pdf_storestats *
+pdf_findstats(pdf_store *store, void *dropfunc)
+{
+	pdf_storestats *stats;
+	int i;
+
+	for (i = 0; i < store->nstats; i++)
+		if (store->stats[i].dropfunc == dropfunc)
+			return &store->stats[i];
+
+	/* the last slot counts all the types that do not fit */
+	if (store->nstats == MAXSTATS)
+		return &store->stats[MAXSTATS - 1];
+
+	stats = &store->stats[store->nstats++];
+	memset(stats, 0, sizeof(pdf_storestats));
+	stats->dropfunc = dropfunc;
+	stats->name = pdf_storetypename(dropfunc);
+	return stats;
+}
+
 pdf_store *
 pdf_newstore(void)
 {
 	pdf_store *store;
 	store = fz_malloc(sizeof(pdf_store));
 	store->hash = fz_newhash(4096, sizeof(struct refkey));
-	store->root = nil;
+	store->head = nil;
+	store->size = 0;
+	store->maxsize = PDF_STORESIZE;
+	store->clock = 0;
+	store->nstats = 0;
 	return store;
 }
 
+static void
+pdf_freeitem(pdf_store *store, pdf_item *item)
+{
+	struct refkey refkey;
+	pdf_item *p;
+
+	/* unlink from the hash chain */
+	pdf_makerefkey(&refkey, item->dropfunc, item->key);
+	p = fz_hashfind(store->hash, &refkey);
+	if (p == item)
+	{
+		fz_hashremove(store->hash, &refkey);
+		if (item->chain)
+			fz_hashinsert(store->hash, &refkey, item->chain);
+	}
+	else
+	{
+		while (p && p->chain != item)
+			p = p->chain;
+		if (p)
+			p->chain = item->chain;
+	}
+
+	if (item->prev)
+		item->prev->next = item->next;
+	else
+		store->head = item->next;
+	if (item->next)
+		item->next->prev = item->prev;
+
+	store->size -= item->size;
+	item->stats->count --;
+	item->stats->size -= item->size;
+
+	((void(*)(void*))item->dropfunc)(item->val);
+	fz_dropobj(item->key);
+	fz_free(item);
+}
+
+static pdf_item *
+pdf_lookupitem(pdf_store *store, void *dropfunc, fz_obj *key)
+{
+	struct refkey refkey;
+	pdf_item *item;
+
+	pdf_makerefkey(&refkey, dropfunc, key);
+	item = fz_hashfind(store->hash, &refkey);
+	if (refkey.gen < 0)
+		while (item && fz_objcmp(item->key, key))
+			item = item->chain;
+	return item;
+}
+
+/*
+ * Drop the items with the least credit until the store is within
+ * maxsize. This is a scan of all the items for each one that goes,
+ * which is cheap next to loading the resources that are dropped.
+ */
+static void
+pdf_evictstore(pdf_store *store, int maxsize)
+{
+	pdf_item *item, *victim;
+
+	while (store->size > maxsize && store->head)
+	{
+		victim = store->head;
+		for (item = store->head->next; item; item = item->next)
+			if (item->credit <= victim->credit)
+				victim = item;
+
+		pdf_logrsrc("evict item %p size %d\n", victim->val, victim->size);
+		store->clock = victim->credit;
+		victim->stats->evictions ++;
+		pdf_freeitem(store, victim);
+	}
+}
+
 void
-pdf_storeitem(pdf_store *store, void *keepfunc, void *dropfunc, fz_obj *key, void *val)
+pdf_storeitem(pdf_store *store, void *keepfunc, void *dropfunc, fz_obj *key, void *val, int size)
 {
+	struct refkey refkey;
 	pdf_item *item;
 
 	if (!store)
 		return;
 
 	item = fz_malloc(sizeof(pdf_item));
+	item->keepfunc = keepfunc;
 	item->dropfunc = dropfunc;
 	item->key = fz_keepobj(key);
 	item->val = ((void*(*)(void*))keepfunc)(val);
+	item->size = MAX(size, 1);
 	item->age = 0;
-	item->next = nil;
+	item->credit = store->clock + 1.0 / item->size;
+	item->stats = pdf_findstats(store, dropfunc);
+	item->chain = nil;
 
 	if (fz_isindirect(key))
-	{
-		struct refkey refkey;
-		pdf_logrsrc("store item (%d %d R) ptr=%p\n", fz_tonum(key), fz_togen(key), val);
-		refkey.dropfunc = dropfunc;
-		refkey.num = fz_tonum(key);
-		refkey.gen = fz_togen(key);
-		fz_hashinsert(store->hash, &refkey, item);
-	}
+		pdf_logrsrc("store item (%d %d R) ptr=%p size=%d\n", fz_tonum(key), fz_togen(key), val, size);
 	else
+		pdf_logrsrc("store item (...) = %p size=%d\n", val, size);
+
+	/* put it at the head of its hash chain */
+	pdf_makerefkey(&refkey, dropfunc, key);
+	item->chain = fz_hashfind(store->hash, &refkey);
+	if (item->chain)
+		fz_hashremove(store->hash, &refkey);
+	fz_hashinsert(store->hash, &refkey, item);
+
+	item->prev = nil;
+	item->next = store->head;
+	if (store->head)
+		store->head->prev = item;
+	store->head = item;
+
+	store->size += item->size;
+	item->stats->count ++;
+	item->stats->size += item->size;
+
+	pdf_evictstore(store, store->maxsize);
+}
+
+/*
+ * Find an item and keep it for the caller. If nil is returned the
+ * caller loads the item and gives it to pdf_storeitem.
+ */
+void *
+pdf_claimitem(pdf_store *store, void *dropfunc, fz_obj *key)
+{
+	pdf_item *item;
+
+	if (!store)
+		return nil;
+
+	if (key == nil)
+		return nil;
+
+	item = pdf_lookupitem(store, dropfunc, key);
+	if (item)
 	{
-		pdf_logrsrc("store item (...) = %p\n", val);
-		item->next = store->root;
-		store->root = item;
+		item->age = 0;
+		item->credit = store->clock + 1.0 / item->size;
+		item->stats->hits ++;
+		return ((void*(*)(void*))item->keepfunc)(item->val);
 	}
+
+	pdf_findstats(store, dropfunc)->misses ++;
+	return nil;
 }
 
+/*
+ * Look for an item without keeping it, so it may go the next time
+ * the store drops items; loaders use pdf_claimitem.
+ */
 void *
 pdf_finditem(pdf_store *store, void *dropfunc, fz_obj *key)
 {
-	struct refkey refkey;
 	pdf_item *item;
 
 	if (!store)
@@ -79,146 +292,116 @@ pdf_finditem(pdf_store *store, void *dropfunc, fz_obj *key)
 	if (key == nil)
 		return nil;
 
-	if (fz_isindirect(key))
-	{
-		refkey.dropfunc = dropfunc;
-		refkey.num = fz_tonum(key);
-		refkey.gen = fz_togen(key);
-		item = fz_hashfind(store->hash, &refkey);
-		if (item)
-		{
-			item->age = 0;
-			return item->val;
-		}
-	}
-	else
+	item = pdf_lookupitem(store, dropfunc, key);
+	if (item)
 	{
-		for (item = store->root; item; item = item->next)
-		{
-			if (item->dropfunc == dropfunc && !fz_objcmp(item->key, key))
-			{
-				item->age = 0;
-				return item->val;
-			}
-		}
+		item->age = 0;
+		item->credit = store->clock + 1.0 / item->size;
+		item->stats->hits ++;
+		return item->val;
 	}
 
+	pdf_findstats(store, dropfunc)->misses ++;
 	return nil;
 }
 
 void
 pdf_removeitem(pdf_store *store, void *dropfunc, fz_obj *key)
 {
-	struct refkey refkey;
-	pdf_item *item, *prev, *next;
+	pdf_item *item;
 
-	if (fz_isindirect(key))
-	{
-		refkey.dropfunc = dropfunc;
-		refkey.num = fz_tonum(key);
-		refkey.gen = fz_togen(key);
-		item = fz_hashfind(store->hash, &refkey);
-		if (item)
-		{
-			fz_hashremove(store->hash, &refkey);
-			((void(*)(void*))item->dropfunc)(item->val);
-			fz_dropobj(item->key);
-			fz_free(item);
-		}
-	}
-	else
-	{
-		prev = nil;
-		for (item = store->root; item; item = next)
-		{
-			next = item->next;
-			if (item->dropfunc == dropfunc && !fz_objcmp(item->key, key))
-			{
-				if (!prev)
-					store->root = next;
-				else
-					prev->next = next;
-				((void(*)(void*))item->dropfunc)(item->val);
-				fz_dropobj(item->key);
-				fz_free(item);
-			}
-			else
-				prev = item;
-		}
-	}
+	if (!store)
+		return;
+
+	item = pdf_lookupitem(store, dropfunc, key);
+	if (item)
+		pdf_freeitem(store, item);
 }
 
+/*
+ * Set the number of bytes of resources to keep.
+ */
 void
-pdf_agestore(pdf_store *store, int maxage)
+pdf_setstoresize(pdf_store *store, int maxsize)
 {
-	struct refkey *refkey;
-	pdf_item *item, *prev, *next;
-	int i;
+	store->maxsize = MAX(maxsize, 0);
+	pdf_evictstore(store, store->maxsize);
+}
 
-	for (i = 0; i < fz_hashlen(store->hash); i++)
-	{
-		refkey = fz_hashgetkey(store->hash, i);
-		item = fz_hashgetval(store->hash, i);
-		if (item && ++item->age > maxage)
-		{
-			fz_hashremove(store->hash, refkey);
-			((void(*)(void*))item->dropfunc)(item->val);
-			fz_dropobj(item->key);
-			fz_free(item);
-			i--; /* items with same hash may move into place */
-		}
-	}
+/*
+ * Drop the items that have not been found in the last maxage calls.
+ * The byte budget is enough to bound the store; this is for callers
+ * that want to let go of resources they know they are done with.
+ */
+void
+pdf_agestore(pdf_store *store, int maxage)
+{
+	pdf_item *item, *next;
 
-	prev = nil;
-	for (item = store->root; item; item = next)
+	for (item = store->head; item; item = next)
 	{
 		next = item->next;
 		if (++item->age > maxage)
-		{
-			if (!prev)
-				store->root = next;
-			else
-				prev->next = next;
-			((void(*)(void*))item->dropfunc)(item->val);
-			fz_dropobj(item->key);
-			fz_free(item);
-		}
-		else
-			prev = item;
+			pdf_freeitem(store, item);
 	}
 }
 
 void
 pdf_freestore(pdf_store *store)
 {
-	pdf_agestore(store, 0);
+	while (store->head)
+		pdf_freeitem(store, store->head);
 	fz_freehash(store->hash);
 	fz_free(store);
 }
 
+/*
+ * Get the statistics for each type of item. Returns the number
+ * of types; the array belongs to the store.
+ */
+int
+pdf_getstorestats(pdf_store *store, pdf_storestats **statsp)
+{
+	*statsp = store->stats;
+	return store->nstats;
+}
+
 void
-pdf_debugstore(pdf_store *store)
+pdf_debugstorestats(pdf_store *store)
 {
-	pdf_item *item;
-	pdf_item *next;
-	struct refkey *refkey;
+	pdf_storestats *stats;
 	int i;
 
-	printf("-- resource store contents --\n");
-
-	for (i = 0; i < fz_hashlen(store->hash); i++)
+	printf("-- resource store --\n");
+	printf("  %d of %d bytes\n", store->size, store->maxsize);
+	for (i = 0; i < store->nstats; i++)
 	{
-		refkey = fz_hashgetkey(store->hash, i);
-		item = fz_hashgetval(store->hash, i);
-		if (item)
-			printf("store[%d] (%d %d R) = %p\n", i, refkey->num, refkey->gen, item->val);
+		stats = &store->stats[i];
+		printf("  %-10s %d items, %d bytes, %d hits, %d misses, %d evictions\n",
+			stats->name, stats->count, stats->size,
+			stats->hits, stats->misses, stats->evictions);
 	}
+}
+
+void
+pdf_debugstore(pdf_store *store)
+{
+	pdf_item *item;
 
-	for (item = store->root; item; item = next)
+	printf("-- resource store contents --\n");
+
+	for (item = store->head; item; item = item->next)
 	{
-		next = item->next;
-		printf("store[*] ");
-		fz_debugobj(item->key);
-		printf(" = %p\n", item->val);
+		if (fz_isindirect(item->key))
+		{
+			printf("store[%s] (%d %d R) = %p, %d bytes\n", item->stats->name,
+				fz_tonum(item->key), fz_togen(item->key), item->val, item->size);
+		}
+		else
+		{
+			printf("store[%s] ", item->stats->name);
+			fz_debugobj(item->key);
+			printf(" = %p, %d bytes\n", item->val, item->size);
+		}
 	}
 }
@@ -165,23 +165,43 @@ buildfilterchain(fz_stream *chain, pdf_xref *xref, fz_obj *fs, fz_obj *ps, int n
 	return chain;
 }
 
+/*
+ * Open a new cursor on the file, so that streams can be read
+ * independently of xref->file and of each other. Files that are
+ * not read from a source have to share xref->file.
+ */
+static fz_stream *
+pdf_opencursor(pdf_xref *xref)
+{
+	fz_source *src = fz_streamsource(xref->file);
+	if (src)
+		return fz_opensource(src);
+	return fz_keepstream(xref->file);
+}
+
 /*
  * Build a filter for reading raw stream data.
  * This is a null filter to constrain reading to the
  * stream length, followed by a decryption filter.
+ * Cross-reference streams are never encrypted, and
+ * since the xref is read lazily they may be opened
+ * after the crypt has been set up.
+ * Assume ownership of chain.
  */
 static fz_stream *
 pdf_openrawfilter(fz_stream *chain, pdf_xref *xref, fz_obj *stmobj, int num, int gen)
 {
+	fz_obj *type;
 	int hascrypt;
 	int len;
 
-	/* don't close chain when we close this filter */
-	fz_keepstream(chain);
-
-	len = fz_toint(fz_dictgets(stmobj, "Length"));
+	len = fz_toint(fz_dictget(stmobj, FZ_NAME(Length)));
 	chain = fz_opennull(chain, len);
 
+	type = fz_dictget(stmobj, FZ_NAME(Type));
+	if (fz_isname(type) && !strcmp(fz_toname(type), "XRef"))
+		return chain;
+
 	hascrypt = pdf_streamhascrypt(stmobj);
 	if (xref->crypt && !hascrypt)
 		chain = pdf_opencrypt(chain, xref->crypt, &xref->crypt->stmf, num, gen);
@@ -192,6 +212,7 @@ pdf_openrawfilter(fz_stream *chain, pdf_xref *xref, fz_obj *stmobj, int num, int
 /*
  * Construct a filter to decode a stream, constraining
  * to stream length and decrypting.
+ * Assume ownership of chain.
  */
 static fz_stream *
 pdf_openfilter(fz_stream *chain, pdf_xref *xref, fz_obj *stmobj, int num, int gen)
@@ -236,9 +257,258 @@ pdf_openinlinestream(fz_stream *chain, pdf_xref *xref, fz_obj *stmobj, int lengt
 	return fz_opennull(chain, length);
 }
 
+/*
+ * Cache of decoded stream contents, keyed on object number.
+ * Buffers are kept in most recently used order and the least
+ * recently used are dropped when the cache grows past its budget.
+ * Cached buffers are shared, so they must not be changed.
+ */
+
+typedef struct pdf_cachedstream_s pdf_cachedstream;
+
+struct pdf_cachedstream_s
+{
+	int num;
+	int gen;
+	fz_buffer *buf;
+	pdf_cachedstream *prev;
+	pdf_cachedstream *next;
+};
+
+struct pdf_streamcache_s
+{
+	fz_hashtable *hash;
+	pdf_cachedstream *head;	/* most recently used */
+	pdf_cachedstream *tail;	/* least recently used */
+	int size;
+	int maxsize;
+	int hits;
+	int misses;
+	int evictions;
+};
+
+struct streamkey
+{
+	int num;
+	int gen;
+};
+
+static pdf_streamcache *
+pdf_getstreamcache(pdf_xref *xref)
+{
+	pdf_streamcache *cache = xref->streamcache;
+	if (!cache)
+	{
+		cache = fz_malloc(sizeof(pdf_streamcache));
+		cache->hash = fz_newhash(256, sizeof(struct streamkey));
+		cache->head = nil;
+		cache->tail = nil;
+		cache->size = 0;
+		cache->maxsize = PDF_STREAMCACHESIZE;
+		cache->hits = 0;
+		cache->misses = 0;
+		cache->evictions = 0;
+		xref->streamcache = cache;
+	}
+	return cache;
+}
+
+static void
+pdf_unlinkcachedstream(pdf_streamcache *cache, pdf_cachedstream *item)
+{
+	if (item->prev)
+		item->prev->next = item->next;
+	else
+		cache->head = item->next;
+	if (item->next)
+		item->next->prev = item->prev;
+	else
+		cache->tail = item->prev;
+}
+
+static void
+pdf_dropcachedstream(pdf_streamcache *cache, pdf_cachedstream *item)
+{
+	struct streamkey key;
+	key.num = item->num;
+	key.gen = item->gen;
+	fz_hashremove(cache->hash, &key);
+	pdf_unlinkcachedstream(cache, item);
+	cache->size -= item->buf->len;
+	fz_dropbuffer(item->buf);
+	fz_free(item);
+}
+
+static void
+pdf_trimstreamcache(pdf_streamcache *cache, int maxsize)
+{
+	while (cache->tail && cache->size > maxsize)
+	{
+		pdf_dropcachedstream(cache, cache->tail);
+		cache->evictions ++;
+	}
+}
+
+static fz_buffer *
+pdf_findcachedstream(pdf_xref *xref, int num, int gen)
+{
+	pdf_streamcache *cache;
+	pdf_cachedstream *item;
+	struct streamkey key;
+
+	cache = pdf_getstreamcache(xref);
+	if (cache->maxsize <= 0)
+		return nil;
+
+	key.num = num;
+	key.gen = gen;
+	item = fz_hashfind(cache->hash, &key);
+	if (!item)
+	{
+		cache->misses ++;
+		return nil;
+	}
+
+	cache->hits ++;
+	if (item != cache->head)
+	{
+		pdf_unlinkcachedstream(cache, item);
+		item->prev = nil;
+		item->next = cache->head;
+		cache->head->prev = item;
+		cache->head = item;
+	}
+
+	return item->buf;
+}
+
+void
+pdf_cachestream(pdf_xref *xref, int num, int gen, fz_buffer *buf)
+{
+	pdf_streamcache *cache;
+	pdf_cachedstream *item;
+	struct streamkey key;
+
+	cache = pdf_getstreamcache(xref);
+
+	/* one large stream should not flush everything else */
+	if (buf->len > pdf_streamcachelimit(xref))
+		return;
+
+	key.num = num;
+	key.gen = gen;
+	if (fz_hashfind(cache->hash, &key))
+		return;
+
+	pdf_trimstreamcache(cache, cache->maxsize - buf->len);
+
+	item = fz_malloc(sizeof(pdf_cachedstream));
+	item->num = num;
+	item->gen = gen;
+	item->buf = fz_keepbuffer(buf);
+	item->prev = nil;
+	item->next = cache->head;
+	if (cache->head)
+		cache->head->prev = item;
+	else
+		cache->tail = item;
+	cache->head = item;
+	cache->size += buf->len;
+
+	fz_hashinsert(cache->hash, &key, item);
+}
+
+int
+pdf_iscachedstream(pdf_xref *xref, int num, int gen)
+{
+	struct streamkey key;
+
+	if (!xref->streamcache)
+		return 0;
+
+	key.num = num;
+	key.gen = gen;
+	return fz_hashfind(xref->streamcache->hash, &key) != nil;
+}
+
+/*
+ * The size of the largest decoded stream the cache will take.
+ */
+int
+pdf_streamcachelimit(pdf_xref *xref)
+{
+	return MAX(pdf_getstreamcache(xref)->maxsize / 4, 0);
+}
+
+/*
+ * Forget the decoded contents of a stream, e.g. when the object changes.
+ */
+void
+pdf_uncachestream(pdf_xref *xref, int num, int gen)
+{
+	pdf_cachedstream *item;
+	struct streamkey key;
+
+	if (!xref->streamcache)
+		return;
+
+	key.num = num;
+	key.gen = gen;
+	item = fz_hashfind(xref->streamcache->hash, &key);
+	if (item)
+		pdf_dropcachedstream(xref->streamcache, item);
+}
+
+/*
+ * Set the number of bytes of decoded streams to keep.
+ * Zero turns the cache off.
+ */
+void
+pdf_setstreamcachesize(pdf_xref *xref, int maxsize)
+{
+	pdf_streamcache *cache = pdf_getstreamcache(xref);
+	cache->maxsize = MAX(maxsize, 0);
+	pdf_trimstreamcache(cache, cache->maxsize);
+}
+
+void
+pdf_freestreamcache(pdf_xref *xref)
+{
+	pdf_streamcache *cache = xref->streamcache;
+
+	if (!cache)
+		return;
+
+	while (cache->head)
+		pdf_dropcachedstream(cache, cache->head);
+	fz_freehash(cache->hash);
+	fz_free(cache);
+	xref->streamcache = nil;
+}
+
+void
+pdf_debugstreamcache(pdf_xref *xref)
+{
+	pdf_streamcache *cache = xref->streamcache;
+	pdf_cachedstream *item;
+	int n = 0;
+
+	if (!cache)
+	{
+		printf("-- stream cache unused --\n");
+		return;
+	}
+
+	for (item = cache->head; item; item = item->next)
+		n ++;
+
+	printf("-- stream cache --\n");
+	printf("  %d streams, %d of %d bytes\n", n, cache->size, cache->maxsize);
+	printf("  %d hits, %d misses, %d evictions\n", cache->hits, cache->misses, cache->evictions);
+}
+
 /*
  * Open a stream for reading the raw (compressed but decrypted) data.
- * Using xref->file while this is open is a bad idea.
  */
 fz_error
 pdf_openrawstream(fz_stream **stmp, pdf_xref *xref, int num, int gen)
@@ -257,8 +527,10 @@ pdf_openrawstream(fz_stream **stmp, pdf_xref *xref, int num, int gen)
 
 	if (x->stmofs)
 	{
-		*stmp = pdf_openrawfilter(xref->file, xref, x->obj, num, gen);
-		fz_seek(xref->file, x->stmofs, 0);
+		fz_stream *file = pdf_opencursor(xref);
+		pdf_prefetchrange(xref, x->stmofs, fz_toint(fz_dictget(x->obj, FZ_NAME(Length))));
+		*stmp = pdf_openrawfilter(file, xref, x->obj, num, gen);
+		fz_seek(file, x->stmofs, 0);
 		return fz_okay;
 	}
 
@@ -267,8 +539,9 @@ pdf_openrawstream(fz_stream **stmp, pdf_xref *xref, int num, int gen)
 
 /*
  * Open a stream for reading uncompressed data.
- * Put the opened file in xref->stream.
- * Using xref->file while a stream is open is a Bad idea.
+ * Each stream has its own cursor on the file when the file
+ * allows it; otherwise using xref->file while a stream is
+ * open is a Bad idea.
  */
 fz_error
 pdf_openstream(fz_stream **stmp, pdf_xref *xref, int num, int gen)
@@ -287,8 +560,20 @@ pdf_openstream(fz_stream **stmp, pdf_xref *xref, int num, int gen)
 
 	if (x->stmofs)
 	{
-		*stmp = pdf_openfilter(xref->file, xref, x->obj, num, gen);
-		fz_seek(xref->file, x->stmofs, 0);
+		fz_stream *file;
+		fz_buffer *buf;
+
+		buf = pdf_findcachedstream(xref, num, gen);
+		if (buf)
+		{
+			*stmp = fz_openbuffer(buf);
+			return fz_okay;
+		}
+
+		file = pdf_opencursor(xref);
+		pdf_prefetchrange(xref, x->stmofs, fz_toint(fz_dictget(x->obj, FZ_NAME(Length))));
+		*stmp = pdf_openfilter(file, xref, x->obj, num, gen);
+		fz_seek(file, x->stmofs, 0);
 		return fz_okay;
 	}
 
@@ -296,17 +581,40 @@ pdf_openstream(fz_stream **stmp, pdf_xref *xref, int num, int gen)
 }
 
 fz_error
-pdf_openstreamat(fz_stream **stmp, pdf_xref *xref, int num, int gen, fz_obj *dict, int stmofs)
+pdf_openstreamat(fz_stream **stmp, pdf_xref *xref, int num, int gen, fz_obj *dict, fz_off_t stmofs)
 {
 	if (stmofs)
 	{
-		*stmp = pdf_openfilter(xref->file, xref, dict, num, gen);
-		fz_seek(xref->file, stmofs, 0);
+		fz_stream *file = pdf_opencursor(xref);
+		pdf_prefetchrange(xref, stmofs, fz_toint(fz_dictget(dict, FZ_NAME(Length))));
+		*stmp = pdf_openfilter(file, xref, dict, num, gen);
+		fz_seek(file, stmofs, 0);
 		return fz_okay;
 	}
 	return fz_throw("object is not a stream");
 }
 
+/*
+ * Unencrypted data that needs no decoding is handed out as a view
+ * of the file when the whole file is in memory.
+ */
+static fz_buffer *
+pdf_loadstreamview(pdf_xref *xref, int num, int len)
+{
+	fz_buffer *file;
+	fz_off_t ofs;
+
+	file = fz_streambuffer(xref->file);
+	if (!file || xref->crypt || num < 0 || num >= xref->len)
+		return nil;
+
+	ofs = xref->table[num].stmofs;
+	if (ofs <= 0 || ofs > file->len)
+		return nil;
+
+	return fz_newbufferview(file, ofs, len);
+}
+
 /*
  * Load raw (compressed but decrypted) contents of a stream into buf.
  */
@@ -322,10 +630,14 @@ pdf_loadrawstream(fz_buffer **bufp, pdf_xref *xref, int num, int gen)
 	if (error)
 		return fz_rethrow(error, "cannot load stream dictionary (%d %d R)", num, gen);
 
-	len = fz_toint(fz_dictgets(dict, "Length"));
+	len = fz_toint(fz_dictget(dict, FZ_NAME(Length)));
 
 	fz_dropobj(dict);
 
+	*bufp = pdf_loadstreamview(xref, num, len);
+	if (*bufp)
+		return fz_okay;
+
 	error = pdf_openrawstream(&stm, xref, num, gen);
 	if (error)
 		return fz_rethrow(error, "cannot open raw stream (%d %d R)", num, gen);
@@ -357,6 +669,43 @@ pdf_guessfilterlength(int len, char *filter)
 	return len;
 }
 
+static int
+pdf_isflatefilter(fz_obj *filter)
+{
+	if (fz_isarray(filter) && fz_arraylen(filter) == 1)
+		filter = fz_arrayget(filter, 0);
+	return fz_isname(filter) &&
+		(!strcmp(fz_toname(filter), "FlateDecode") || !strcmp(fz_toname(filter), "Fl"));
+}
+
+/*
+ * Streams that are only flate compressed are inflated from the raw
+ * data in one go, and any predictor is undone in place, instead of
+ * pulling the data through a chain of filters.
+ */
+static fz_error
+pdf_loadflatestream(fz_buffer **bufp, pdf_xref *xref, int num, int gen, fz_obj *params, int len)
+{
+	fz_error error;
+	fz_buffer *raw;
+
+	error = pdf_loadrawstream(&raw, xref, num, gen);
+	if (error)
+		return fz_rethrow(error, "cannot load raw stream (%d %d R)", num, gen);
+
+	error = fz_inflate(bufp, raw->data, raw->len, len);
+	fz_dropbuffer(raw);
+	if (error)
+		return fz_rethrow(error, "cannot inflate stream (%d %d R)", num, gen);
+
+	if (fz_isarray(params))
+		params = fz_arrayget(params, 0);
+	if (fz_toint(fz_dictgets(params, "Predictor")) > 1)
+		fz_predictbuffer(*bufp, params);
+
+	return fz_okay;
+}
+
 /*
  * Load uncompressed contents of a stream into buf.
  */
@@ -368,21 +717,50 @@ pdf_loadstream(fz_buffer **bufp, pdf_xref *xref, int num, int gen)
 	fz_obj *dict, *obj;
 	int i, len;
 
-	error = pdf_openstream(&stm, xref, num, gen);
-	if (error)
-		return fz_rethrow(error, "cannot open stream (%d %d R)", num, gen);
-
 	error = pdf_loadobject(&dict, xref, num, gen);
 	if (error)
 		return fz_rethrow(error, "cannot load stream dictionary (%d %d R)", num, gen);
 
-	len = fz_toint(fz_dictgets(dict, "Length"));
-	obj = fz_dictgets(dict, "Filter");
-	len = pdf_guessfilterlength(len, fz_toname(obj));
-	for (i = 0; i < fz_arraylen(obj); i++)
-		len = pdf_guessfilterlength(len, fz_toname(fz_arrayget(obj, i)));
+	*bufp = pdf_findcachedstream(xref, num, gen);
+	if (*bufp)
+	{
+		fz_dropobj(dict);
+		fz_keepbuffer(*bufp);
+		return fz_okay;
+	}
 
-	fz_dropobj(dict);
+	len = fz_toint(fz_dictget(dict, FZ_NAME(Length)));
+	obj = fz_dictgetsa(dict, "Filter", "F");
+
+	if (!obj)
+	{
+		fz_dropobj(dict);
+		*bufp = pdf_loadstreamview(xref, num, len);
+		if (*bufp)
+			return fz_okay;
+	}
+	else
+	{
+		len = pdf_guessfilterlength(len, fz_toname(obj));
+		for (i = 0; i < fz_arraylen(obj); i++)
+			len = pdf_guessfilterlength(len, fz_toname(fz_arrayget(obj, i)));
+
+		if (pdf_isflatefilter(obj))
+		{
+			error = pdf_loadflatestream(bufp, xref, num, gen, fz_dictgetsa(dict, "DecodeParms", "DP"), len);
+			fz_dropobj(dict);
+			if (error)
+				return fz_rethrow(error, "cannot load stream (%d %d R)", num, gen);
+			pdf_cachestream(xref, num, gen, *bufp);
+			return fz_okay;
+		}
+
+		fz_dropobj(dict);
+	}
+
+	error = pdf_openstream(&stm, xref, num, gen);
+	if (error)
+		return fz_rethrow(error, "cannot open stream (%d %d R)", num, gen);
 
 	error = fz_readall(bufp, stm, len);
 	if (error)
@@ -392,5 +770,8 @@ pdf_loadstream(fz_buffer **bufp, pdf_xref *xref, int num, int gen)
 	}
 
 	fz_close(stm);
+
+	pdf_cachestream(xref, num, gen, *bufp);
+
 	return fz_okay;
 }
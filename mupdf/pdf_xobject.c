@@ -8,11 +8,8 @@ pdf_loadxobject(pdf_xobject **formp, pdf_xref *xref, fz_obj *dict)
 	pdf_xobject *form;
 	fz_obj *obj;
 
-	if ((*formp = pdf_finditem(xref->store, pdf_dropxobject, dict)))
-	{
-		pdf_keepxobject(*formp);
+	if ((*formp = pdf_claimitem(xref->store, pdf_dropxobject, dict)))
 		return fz_okay;
-	}
 
 	form = fz_malloc(sizeof(pdf_xobject));
 	form->refs = 1;
@@ -22,9 +19,6 @@ pdf_loadxobject(pdf_xobject **formp, pdf_xref *xref, fz_obj *dict)
 
 	pdf_logrsrc("load xobject (%d %d R) ptr=%p {\n", fz_tonum(dict), fz_togen(dict), form);
 
-	/* Store item immediately, to avoid possible recursion if objects refer back to this one */
-	pdf_storeitem(xref->store, pdf_keepxobject, pdf_dropxobject, dict, form);
-
 	obj = fz_dictgets(dict, "BBox");
 	form->bbox = pdf_torect(obj);
 
@@ -80,7 +74,6 @@ pdf_loadxobject(pdf_xobject **formp, pdf_xref *xref, fz_obj *dict)
 	error = pdf_loadstream(&form->contents, xref, fz_tonum(dict), fz_togen(dict));
 	if (error)
 	{
-		pdf_removeitem(xref->store, pdf_dropxobject, dict);
 		pdf_dropxobject(form);
 		return fz_rethrow(error, "cannot load xobject content stream (%d %d R)", fz_tonum(dict), fz_togen(dict));
 	}
@@ -88,6 +81,10 @@ pdf_loadxobject(pdf_xobject **formp, pdf_xref *xref, fz_obj *dict)
 	pdf_logrsrc("stream %d bytes\n", form->contents->len);
 	pdf_logrsrc("}\n");
 
+	/* Stored only when complete, so it is never found half loaded */
+	pdf_storeitem(xref->store, pdf_keepxobject, pdf_dropxobject, dict, form,
+		sizeof(pdf_xobject) + form->contents->len);
+
 	*formp = form;
 	return fz_okay;
 }
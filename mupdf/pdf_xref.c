@@ -8,6 +8,17 @@ static inline int iswhite(int ch)
 		ch == '\014' || ch == '\015' || ch == '\040';
 }
 
+/*
+ * Hint to the file's source that a range of bytes will be read soon.
+ */
+void
+pdf_prefetchrange(pdf_xref *xref, fz_off_t ofs, fz_off_t len)
+{
+	fz_source *src = fz_streamsource(xref->file);
+	if (src)
+		fz_prefetchsource(src, ofs, len);
+}
+
 /*
  * magic version tag and startxref
  */
@@ -33,14 +44,15 @@ static fz_error
 pdf_readstartxref(pdf_xref *xref)
 {
 	unsigned char buf[1024];
-	int t, n;
+	fz_off_t t;
+	int n;
 	int i;
 
 	fz_seek(xref->file, 0, 2);
 
 	xref->filesize = fz_tell(xref->file);
 
-	t = MAX(0, xref->filesize - (int)sizeof buf);
+	t = MAX(0, xref->filesize - (fz_off_t)sizeof buf);
 	fz_seek(xref->file, t, 0);
 
 	n = fz_read(xref->file, buf, sizeof buf);
@@ -54,8 +66,8 @@ pdf_readstartxref(pdf_xref *xref)
 			i += 9;
 			while (iswhite(buf[i]) && i < n)
 				i ++;
-			xref->startxref = atoi((char*)(buf + i));
-			pdf_logxref("startxref %d\n", xref->startxref);
+			xref->startxref = strtoll((char*)(buf + i), nil, 10);
+			pdf_logxref("startxref %lld\n", xref->startxref);
 			return fz_okay;
 		}
 	}
@@ -74,7 +86,7 @@ pdf_readoldtrailer(pdf_xref *xref, char *buf, int cap)
 	int len;
 	char *s;
 	int n;
-	int t;
+	fz_off_t t;
 	int tok;
 	int c;
 
@@ -105,7 +117,7 @@ pdf_readoldtrailer(pdf_xref *xref, char *buf, int cap)
 		if (t < 0)
 			return fz_throw("cannot tell in file");
 
-		fz_seek(xref->file, t + 20 * len, 0);
+		fz_seek(xref->file, t + 20 * (fz_off_t)len, 0);
 	}
 
 	error = pdf_lex(&tok, xref->file, buf, cap, &n);
@@ -188,20 +200,96 @@ pdf_resizexref(pdf_xref *xref, int newlen)
 		xref->table[i].gen = 0;
 		xref->table[i].stmofs = 0;
 		xref->table[i].obj = nil;
+		xref->table[i].age = 0;
 	}
 	xref->len = newlen;
 }
 
+/*
+ * The xref sections are not read in full when the file is opened.
+ * Only their subsection headers and trailers are, and an entry is
+ * looked up in the sections the first time its object is asked for.
+ * The sections are kept in the order their entries take precedence:
+ * each section first, then its /XRefStm, then the ones it chains to.
+ */
+
+typedef struct pdf_xrefsection_s pdf_xrefsection;
+typedef struct pdf_xrefsubsec_s pdf_xrefsubsec;
+
+struct pdf_xrefsubsec_s
+{
+	int start;
+	int len;
+	fz_off_t ofs;	/* of the first entry, in the file or the decoded stream */
+};
+
+struct pdf_xrefsection_s
+{
+	fz_off_t ofs;
+	int w0, w1, w2;	/* entry field widths, zero for old style tables */
+	int num, gen;	/* xref stream object */
+	fz_off_t stmofs;
+	fz_obj *dict;
+	fz_buffer *data;	/* decoded xref stream, nil until needed */
+	int len;
+	int cap;
+	pdf_xrefsubsec *subs;
+};
+
+static pdf_xrefsection *
+pdf_newxrefsection(pdf_xref *xref, fz_off_t ofs)
+{
+	pdf_xrefsection *sec;
+
+	xref->sections = fz_realloc(xref->sections, xref->nsections + 1, sizeof(pdf_xrefsection));
+	sec = &xref->sections[xref->nsections++];
+	memset(sec, 0, sizeof(pdf_xrefsection));
+	sec->ofs = ofs;
+	return sec;
+}
+
+static void
+pdf_addxrefsubsec(pdf_xrefsection *sec, int start, int len, fz_off_t ofs)
+{
+	if (sec->len == sec->cap)
+	{
+		sec->cap = sec->cap * 2 + 1;
+		sec->subs = fz_realloc(sec->subs, sec->cap, sizeof(pdf_xrefsubsec));
+	}
+	sec->subs[sec->len].start = start;
+	sec->subs[sec->len].len = len;
+	sec->subs[sec->len].ofs = ofs;
+	sec->len ++;
+}
+
+static void
+pdf_freexrefsections(pdf_xref *xref)
+{
+	int i;
+
+	for (i = 0; i < xref->nsections; i++)
+	{
+		if (xref->sections[i].dict)
+			fz_dropobj(xref->sections[i].dict);
+		if (xref->sections[i].data)
+			fz_dropbuffer(xref->sections[i].data);
+		fz_free(xref->sections[i].subs);
+	}
+	fz_free(xref->sections);
+	xref->sections = nil;
+	xref->nsections = 0;
+}
+
 static fz_error
-pdf_readoldxref(fz_obj **trailerp, pdf_xref *xref, char *buf, int cap)
+pdf_readoldxref(fz_obj **trailerp, pdf_xref *xref, pdf_xrefsection *sec, char *buf, int cap)
 {
 	fz_error error;
 	int ofs, len;
 	char *s;
 	int n;
 	int tok;
-	int i;
 	int c;
+	fz_off_t t;
 
 	pdf_logxref("load old xref format\n");
 
@@ -227,6 +315,9 @@ pdf_readoldxref(fz_obj **trailerp, pdf_xref *xref, char *buf, int cap)
 			fz_seek(xref->file, -(2 + (int)strlen(s)), 1);
 		}
 
+		if (ofs < 0 || len < 0 || ofs > INT_MAX - len)
+			return fz_throw("invalid xref subsection: %d %d", ofs, len);
+
 		/* broken pdfs where size in trailer undershoots entries in xref sections */
 		if (ofs + len > xref->len)
 		{
@@ -234,26 +325,10 @@ pdf_readoldxref(fz_obj **trailerp, pdf_xref *xref, char *buf, int cap)
 			pdf_resizexref(xref, ofs + len);
 		}
 
-		for (i = ofs; i < ofs + len; i++)
-		{
-			n = fz_read(xref->file, (unsigned char *) buf, 20);
-			if (n < 0)
-				return fz_rethrow(n, "cannot read xref table");
-			if (!xref->table[i].type)
-			{
-				s = buf;
-
-				/* broken pdfs where line start with white space */
-				while (*s != '\0' && iswhite(*s))
-					s++;
-
-				xref->table[i].ofs = atoi(s);
-				xref->table[i].gen = atoi(s + 11);
-				xref->table[i].type = s[17];
-				if (s[17] != 'f' && s[17] != 'n' && s[17] != 'o')
-					return fz_throw("unexpected xref type: %#x (%d %d R)", s[17], i, xref->table[i].gen);
-			}
-		}
+		/* the entries are all 20 bytes, so we can step over them */
+		t = fz_tell(xref->file);
+		pdf_addxrefsubsec(sec, ofs, len, t);
+		fz_seek(xref->file, t + 20 * (fz_off_t)len, 0);
 	}
 
 	error = pdf_lex(&tok, xref->file, buf, cap, &n);
@@ -275,52 +350,17 @@ pdf_readoldxref(fz_obj **trailerp, pdf_xref *xref, char *buf, int cap)
 }
 
 static fz_error
-pdf_readnewxrefsection(pdf_xref *xref, fz_stream *stm, int i0, int i1, int w0, int w1, int w2)
-{
-	int i, n;
-
-	if (i0 < 0 || i0 + i1 > xref->len)
-		return fz_throw("xref stream has too many entries");
-
-	for (i = i0; i < i0 + i1; i++)
-	{
-		int a = 0;
-		int b = 0;
-		int c = 0;
-
-		if (fz_iseof(stm))
-			return fz_throw("truncated xref stream");
-
-		for (n = 0; n < w0; n++)
-			a = (a << 8) + fz_readbyte(stm);
-		for (n = 0; n < w1; n++)
-			b = (b << 8) + fz_readbyte(stm);
-		for (n = 0; n < w2; n++)
-			c = (c << 8) + fz_readbyte(stm);
-
-		if (!xref->table[i].type)
-		{
-			int t = w0 ? a : 1;
-			xref->table[i].type = t == 0 ? 'f' : t == 1 ? 'n' : t == 2 ? 'o' : 0;
-			xref->table[i].ofs = w1 ? b : 0;
-			xref->table[i].gen = w2 ? c : 0;
-		}
-	}
-
-	return fz_okay;
-}
-
-static fz_error
-pdf_readnewxref(fz_obj **trailerp, pdf_xref *xref, char *buf, int cap)
+pdf_readnewxref(fz_obj **trailerp, pdf_xref *xref, pdf_xrefsection *sec, char *buf, int cap)
 {
 	fz_error error;
-	fz_stream *stm;
 	fz_obj *trailer;
 	fz_obj *index;
 	fz_obj *obj;
-	int num, gen, stmofs;
+	int num, gen;
+	fz_off_t stmofs;
 	int size, w0, w1, w2;
-	int t;
+	int i0, i1, t;
+	fz_off_t ofs;
 
 	pdf_logxref("load new xref format\n");
 
@@ -358,52 +398,46 @@ pdf_readnewxref(fz_obj **trailerp, pdf_xref *xref, char *buf, int cap)
 	w1 = fz_toint(fz_arrayget(obj, 1));
 	w2 = fz_toint(fz_arrayget(obj, 2));
 
-	index = fz_dictgets(trailer, "Index");
-
-	error = pdf_openstreamat(&stm, xref, num, gen, trailer, stmofs);
-	if (error)
+	if (w0 < 0 || w0 > 4 || w1 < 0 || w1 > 8 || w2 < 0 || w2 > 4)
 	{
 		fz_dropobj(trailer);
-		return fz_rethrow(error, "cannot open compressed xref stream (%d %d R)", num, gen);
+		return fz_throw("xref stream has invalid field widths (%d %d R)", num, gen);
 	}
 
-	if (!index)
+	sec->w0 = w0;
+	sec->w1 = w1;
+	sec->w2 = w2;
+	sec->num = num;
+	sec->gen = gen;
+	sec->stmofs = stmofs;
+	sec->dict = fz_keepobj(trailer);
+
+	index = fz_dictgets(trailer, "Index");
+
+	ofs = 0;
+	for (t = 0; t < (index ? fz_arraylen(index) : 2); t += 2)
 	{
-		error = pdf_readnewxrefsection(xref, stm, 0, size, w0, w1, w2);
-		if (error)
+		i0 = index ? fz_toint(fz_arrayget(index, t + 0)) : 0;
+		i1 = index ? fz_toint(fz_arrayget(index, t + 1)) : size;
+		if (i0 < 0 || i1 < 0 || i0 > xref->len - i1)
 		{
-			fz_close(stm);
 			fz_dropobj(trailer);
-			return fz_rethrow(error, "cannot read xref stream (%d %d R)", num, gen);
-		}
-	}
-	else
-	{
-		for (t = 0; t < fz_arraylen(index); t += 2)
-		{
-			int i0 = fz_toint(fz_arrayget(index, t + 0));
-			int i1 = fz_toint(fz_arrayget(index, t + 1));
-			error = pdf_readnewxrefsection(xref, stm, i0, i1, w0, w1, w2);
-			if (error)
-			{
-				fz_close(stm);
-				fz_dropobj(trailer);
-				return fz_rethrow(error, "cannot read xref stream section (%d %d R)", num, gen);
-			}
+			return fz_throw("xref stream has too many entries");
 		}
+		pdf_addxrefsubsec(sec, i0, i1, ofs);
+		ofs += (fz_off_t)i1 * (w0 + w1 + w2);
 	}
 
-	fz_close(stm);
-
 	*trailerp = trailer;
 
 	return fz_okay;
 }
 
 static fz_error
-pdf_readxref(fz_obj **trailerp, pdf_xref *xref, int ofs, char *buf, int cap)
+pdf_readxref(fz_obj **trailerp, pdf_xref *xref, fz_off_t ofs, char *buf, int cap)
 {
 	fz_error error;
+	pdf_xrefsection *sec;
 	int c;
 
 	fz_seek(xref->file, ofs, 0);
@@ -411,18 +445,20 @@ pdf_readxref(fz_obj **trailerp, pdf_xref *xref, int ofs, char *buf, int cap)
 	while (iswhite(fz_peekbyte(xref->file)))
 		fz_readbyte(xref->file);
 
+	sec = pdf_newxrefsection(xref, ofs);
+
 	c = fz_peekbyte(xref->file);
 	if (c == 'x')
 	{
-		error = pdf_readoldxref(trailerp, xref, buf, cap);
+		error = pdf_readoldxref(trailerp, xref, sec, buf, cap);
 		if (error)
-			return fz_rethrow(error, "cannot read xref (ofs=%d)", ofs);
+			return fz_rethrow(error, "cannot read xref (ofs=%lld)", ofs);
 	}
 	else if (c >= '0' && c <= '9')
 	{
-		error = pdf_readnewxref(trailerp, xref, buf, cap);
+		error = pdf_readnewxref(trailerp, xref, sec, buf, cap);
 		if (error)
-			return fz_rethrow(error, "cannot read xref (ofs=%d)", ofs);
+			return fz_rethrow(error, "cannot read xref (ofs=%lld)", ofs);
 	}
 	else
 	{
@@ -433,12 +469,18 @@ pdf_readxref(fz_obj **trailerp, pdf_xref *xref, int ofs, char *buf, int cap)
 }
 
 static fz_error
-pdf_readxrefsections(pdf_xref *xref, int ofs, char *buf, int cap)
+pdf_readxrefsections(pdf_xref *xref, fz_off_t ofs, char *buf, int cap)
 {
 	fz_error error;
 	fz_obj *trailer;
 	fz_obj *prev;
 	fz_obj *xrefstm;
+	int i;
+
+	/* broken pdfs where the sections chain back to themselves */
+	for (i = 0; i < xref->nsections; i++)
+		if (xref->sections[i].ofs == ofs)
+			return fz_throw("xref sections form a loop (ofs=%lld)", ofs);
 
 	error = pdf_readxref(&trailer, xref, ofs, buf, cap);
 	if (error)
@@ -449,7 +491,7 @@ pdf_readxrefsections(pdf_xref *xref, int ofs, char *buf, int cap)
 	if (xrefstm)
 	{
 		pdf_logxref("load xrefstm\n");
-		error = pdf_readxrefsections(xref, fz_toint(xrefstm), buf, cap);
+		error = pdf_readxrefsections(xref, fz_tooffset(xrefstm), buf, cap);
 		if (error)
 		{
 			fz_dropobj(trailer);
@@ -460,8 +502,8 @@ pdf_readxrefsections(pdf_xref *xref, int ofs, char *buf, int cap)
 	prev = fz_dictgets(trailer, "Prev");
 	if (prev)
 	{
-		pdf_logxref("load prev at %#x\n", fz_toint(prev));
-		error = pdf_readxrefsections(xref, fz_toint(prev), buf, cap);
+		pdf_logxref("load prev at %#llx\n", fz_tooffset(prev));
+		error = pdf_readxrefsections(xref, fz_tooffset(prev), buf, cap);
 		if (error)
 		{
 			fz_dropobj(trailer);
@@ -473,6 +515,300 @@ pdf_readxrefsections(pdf_xref *xref, int ofs, char *buf, int cap)
 	return fz_okay;
 }
 
+/*
+ * Reading entries out of the sections.
+ */
+
+static fz_error
+pdf_setoldxrefentry(pdf_xref *xref, int num, char *buf)
+{
+	pdf_xrefentry *x = &xref->table[num];
+	char *s = buf;
+
+	/* broken pdfs where line start with white space */
+	while (*s != '\0' && iswhite(*s))
+		s++;
+
+	if (s[17] != 'f' && s[17] != 'n' && s[17] != 'o')
+		return fz_throw("unexpected xref type: %#x (%d %d R)", s[17], num, atoi(s + 11));
+
+	x->ofs = strtoll(s, nil, 10);
+	x->gen = atoi(s + 11);
+	x->type = s[17];
+	return fz_okay;
+}
+
+static void
+pdf_setnewxrefentry(pdf_xref *xref, int num, pdf_xrefsection *sec, unsigned char *p)
+{
+	pdf_xrefentry *x = &xref->table[num];
+	int a = 0;
+	fz_off_t b = 0;
+	int c = 0;
+	int n, t;
+
+	for (n = 0; n < sec->w0; n++)
+		a = (a << 8) + *p++;
+	for (n = 0; n < sec->w1; n++)
+		b = (b << 8) + *p++;
+	for (n = 0; n < sec->w2; n++)
+		c = (c << 8) + *p++;
+
+	t = sec->w0 ? a : 1;
+	x->type = t == 0 ? 'f' : t == 1 ? 'n' : t == 2 ? 'o' : 0;
+	x->ofs = sec->w1 ? b : 0;
+	x->gen = sec->w2 ? c : 0;
+}
+
+static fz_error
+pdf_loadxrefstream(pdf_xref *xref, pdf_xrefsection *sec)
+{
+	fz_error error;
+	fz_stream *stm;
+
+	if (sec->data)
+		return fz_okay;
+
+	error = pdf_openstreamat(&stm, xref, sec->num, sec->gen, sec->dict, sec->stmofs);
+	if (error)
+		return fz_rethrow(error, "cannot open compressed xref stream (%d %d R)", sec->num, sec->gen);
+
+	error = fz_readall(&sec->data, stm, fz_toint(fz_dictgets(sec->dict, "Length")) * 3);
+	fz_close(stm);
+	if (error)
+		return fz_rethrow(error, "cannot read compressed xref stream (%d %d R)", sec->num, sec->gen);
+
+	return fz_okay;
+}
+
+/*
+ * Set the entries from first to last in a subsection that are not
+ * set already. A broken entry is an error: the caller repairs the
+ * file, as it would have been repaired at open when the whole table
+ * was read then.
+ */
+static fz_error
+pdf_readxrefsubsec(pdf_xref *xref, pdf_xrefsection *sec, pdf_xrefsubsec *sub, int first, int last)
+{
+	fz_error error;
+	unsigned char *p;
+	char buf[32];
+	int i, n, w;
+
+	if (sec->dict)
+	{
+		error = pdf_loadxrefstream(xref, sec);
+		if (error)
+			return fz_rethrow(error, "cannot read xref section");
+		w = sec->w0 + sec->w1 + sec->w2;
+	}
+	else
+	{
+		w = 20;
+		fz_seek(xref->file, sub->ofs + (fz_off_t)(first - sub->start) * w, 0);
+	}
+
+	for (i = first; i < last; i++)
+	{
+		if (sec->dict)
+		{
+			p = sec->data->data + sub->ofs + (fz_off_t)(i - sub->start) * w;
+			if (p + w > sec->data->data + sec->data->len)
+				return fz_throw("truncated xref stream (%d %d R)", sec->num, sec->gen);
+			if (!xref->table[i].type)
+				pdf_setnewxrefentry(xref, i, sec, p);
+			error = fz_okay;
+		}
+		else
+		{
+			memset(buf, 0, sizeof buf);
+			n = fz_read(xref->file, (unsigned char *) buf, w);
+			if (n < 0)
+				return fz_rethrow(n, "cannot read xref table");
+			if (xref->table[i].type)
+				continue;
+			error = pdf_setoldxrefentry(xref, i, buf);
+		}
+
+		/* broken pdfs where object offsets are out of range */
+		if (!error && xref->table[i].type == 'n' &&
+			(xref->table[i].ofs <= 0 || xref->table[i].ofs >= xref->filesize))
+		{
+			error = fz_throw("object offset out of range: %lld (%d 0 R)", xref->table[i].ofs, i);
+			xref->table[i].type = 0;
+		}
+
+		if (error)
+			return fz_rethrow(error, "cannot read xref entry (%d 0 R)", i);
+	}
+
+	return fz_okay;
+}
+
+/*
+ * Set the entry of an object from the first section that has it.
+ * The entry is left unset if no section does.
+ */
+static fz_error
+pdf_readxrefentry(pdf_xref *xref, int num)
+{
+	fz_error error;
+	pdf_xrefsection *sec;
+	pdf_xrefsubsec *sub;
+	int i, k;
+
+	for (i = 0; i < xref->nsections; i++)
+	{
+		sec = &xref->sections[i];
+		for (k = 0; k < sec->len; k++)
+		{
+			sub = &sec->subs[k];
+			if (num < sub->start || num - sub->start >= sub->len)
+				continue;
+
+			error = pdf_readxrefsubsec(xref, sec, sub, num, num + 1);
+			if (error)
+				return fz_rethrow(error, "cannot find object (%d 0 R) in xref", num);
+			if (xref->table[num].type)
+				return fz_okay;
+		}
+	}
+
+	return fz_okay;
+}
+
+/*
+ * Repair the file when a broken entry is found after it was opened.
+ * The sections are dropped and the table is rebuilt by scanning the
+ * file, as at open, but the trailer and the objects that are already
+ * loaded are kept since they may be in use. The first page named by
+ * the linearization dictionary is not trusted after, as at open.
+ */
+static fz_error
+pdf_repairlazyxref(pdf_xref *xref)
+{
+	fz_error error;
+	fz_obj *trailer;
+
+	pdf_logxref("repair lazy xref\n");
+
+	pdf_freexrefsections(xref);
+	xref->linpage = 0;
+
+	trailer = xref->trailer;
+	xref->trailer = nil;
+	error = pdf_repairxref(xref, xref->scratch, sizeof xref->scratch);
+	if (xref->trailer)
+		fz_dropobj(xref->trailer);
+	xref->trailer = trailer;
+	if (error)
+		return fz_rethrow(error, "cannot repair document");
+
+	error = pdf_repairobjstms(xref);
+	if (error)
+		return fz_rethrow(error, "cannot repair document");
+
+	return fz_okay;
+}
+
+/*
+ * Read all the entries that have not been asked for yet, from the
+ * sections or the xref index, for code that walks the whole of
+ * xref->table. The sections are gone after.
+ */
+fz_error
+pdf_loadlazyxref(pdf_xref *xref)
+{
+	fz_error error;
+	pdf_xrefsection *sec;
+	int i, k;
+
+	if (xref->index)
+	{
+		for (i = 0; i < xref->len; i++)
+			if (xref->table[i].type == 0)
+				pdf_readindexentry(xref, i);
+	}
+
+	if (!xref->sections)
+		return fz_okay;
+
+	pdf_logxref("load rest of xref\n");
+
+	for (i = 0; i < xref->nsections; i++)
+	{
+		sec = &xref->sections[i];
+		for (k = 0; k < sec->len; k++)
+		{
+			error = pdf_readxrefsubsec(xref, sec, &sec->subs[k],
+				sec->subs[k].start, sec->subs[k].start + sec->subs[k].len);
+			if (error)
+			{
+				fz_catch(error, "trying to repair");
+				error = pdf_repairlazyxref(xref);
+				if (error)
+					return fz_rethrow(error, "cannot load xref");
+				return fz_okay;
+			}
+		}
+	}
+
+	pdf_freexrefsections(xref);
+	return fz_okay;
+}
+
+/*
+ * Linearized files start with a dictionary that says where the first
+ * page is, so it can be shown without looking at the page tree.
+ */
+
+static int
+pdf_readlinearization(pdf_xref *xref, char *buf, int cap)
+{
+	fz_error error;
+	fz_obj *dict;
+	fz_off_t stmofs;
+	int num, gen, n, i;
+
+	fz_seek(xref->file, 0, 0);
+	n = fz_read(xref->file, (unsigned char *) buf, MIN(cap, 1024));
+	if (n < 0)
+	{
+		fz_catch(n, "cannot read linearization dictionary");
+		return 0;
+	}
+
+	/* look before we parse, most files are not linearized */
+	for (i = 0; i < n - 11; i++)
+		if (!memcmp(buf + i, "/Linearized", 11))
+			break;
+	if (i >= n - 11)
+		return 0;
+
+	fz_seek(xref->file, 0, 0);
+	fz_readline(xref->file, buf, cap);
+
+	error = pdf_parseindobj(&dict, xref, xref->file, buf, cap, &num, &gen, &stmofs);
+	if (error)
+	{
+		fz_catch(error, "cannot parse linearization dictionary");
+		return 0;
+	}
+
+	if (fz_dictgets(dict, "Linearized") &&
+		fz_tooffset(fz_dictgets(dict, "L")) == xref->filesize &&
+		fz_tooffset(fz_dictgets(dict, "E")) > xref->startxref &&
+		fz_toint(fz_dictgets(dict, "O")) > 0 &&
+		fz_toint(fz_dictgets(dict, "N")) > 0)
+	{
+		xref->linpage = fz_toint(fz_dictgets(dict, "O"));
+		pdf_logxref("linearized: first page %d\n", xref->linpage);
+	}
+
+	fz_dropobj(dict);
+	return xref->linpage > 0;
+}
+
 /*
  * load xref tables from pdf
  */
@@ -482,7 +818,11 @@ pdf_loadxref(pdf_xref *xref, char *buf, int bufsize)
 {
 	fz_error error;
 	fz_obj *size;
-	int i;
+
+	/* the header and the trailer are needed first */
+	pdf_prefetchrange(xref, 0, 1024);
+	fz_seek(xref->file, 0, 2);
+	pdf_prefetchrange(xref, fz_tell(xref->file) - 1024, 1024);
 
 	error = pdf_loadversion(xref);
 	if (error)
@@ -500,7 +840,7 @@ pdf_loadxref(pdf_xref *xref, char *buf, int bufsize)
 	if (!size)
 		return fz_throw("trailer missing Size entry");
 
-	pdf_logxref("\tsize %d at %#x\n", fz_toint(size), xref->startxref);
+	pdf_logxref("\tsize %d at %#llx\n", fz_toint(size), xref->startxref);
 
 	pdf_resizexref(xref, fz_toint(size));
 
@@ -509,14 +849,16 @@ pdf_loadxref(pdf_xref *xref, char *buf, int bufsize)
 		return fz_rethrow(error, "cannot read xref");
 
 	/* broken pdfs where first object is not free */
+	if (xref->len < 1)
+		return fz_throw("xref is empty");
+	error = pdf_readxrefentry(xref, 0);
+	if (error)
+		return fz_rethrow(error, "cannot read xref");
 	if (xref->table[0].type != 'f')
 		return fz_throw("first object in xref is not free");
 
-	/* broken pdfs where object offsets are out of range */
-	for (i = 0; i < xref->len; i++)
-		if (xref->table[i].type == 'n')
-			if (xref->table[i].ofs <= 0 || xref->table[i].ofs >= xref->filesize)
-				return fz_throw("object offset out of range: %d (%d 0 R)", xref->table[i].ofs, i);
+	if (fz_dictgets(xref->trailer, "Prev"))
+		pdf_readlinearization(xref, buf, bufsize);
 
 	return fz_okay;
 }
@@ -524,16 +866,18 @@ pdf_loadxref(pdf_xref *xref, char *buf, int bufsize)
 /*
  * Initialize and load xref tables.
  * If password is not null, try to decrypt.
+ * If indexname is not null, take the tables from the xref index
+ * when it matches the key, and write a new index when it does not.
  */
 
-fz_error
-pdf_openxrefwithstream(pdf_xref **xrefp, fz_stream *file, char *password)
+static fz_error
+pdf_openxrefwithkey(pdf_xref **xrefp, fz_stream *file, char *password, char *indexname, pdf_indexkey *key)
 {
 	pdf_xref *xref;
 	fz_error error;
 	fz_obj *encrypt, *id;
 	fz_obj *dict, *obj;
-	int i, repaired = 0;
+	int i, repaired = 0, indexed = 0, locked = 0;
 
 	xref = fz_malloc(sizeof(pdf_xref));
 
@@ -543,10 +887,17 @@ pdf_openxrefwithstream(pdf_xref **xrefp, fz_stream *file, char *password)
 
 	xref->file = fz_keepstream(file);
 
-	error = pdf_loadxref(xref, xref->scratch, sizeof xref->scratch);
+	if (indexname)
+		indexed = pdf_readxrefindex(xref, indexname, key);
+
+	error = fz_okay;
+	if (!indexed)
+		error = pdf_loadxref(xref, xref->scratch, sizeof xref->scratch);
 	if (error)
 	{
 		fz_catch(error, "trying to repair");
+		pdf_freexrefsections(xref);
+		xref->linpage = 0;
 		if (xref->table)
 		{
 			fz_free(xref->table);
@@ -591,6 +942,8 @@ pdf_openxrefwithstream(pdf_xref **xrefp, fz_stream *file, char *password)
 				return fz_throw("invalid password");
 			}
 		}
+		else
+			locked = 1;
 	}
 
 	if (repaired)
@@ -646,10 +999,24 @@ pdf_openxrefwithstream(pdf_xref **xrefp, fz_stream *file, char *password)
 		}
 	}
 
+	/* the page tree cannot be read for the index before a password is given */
+	if (indexname && !indexed && !locked)
+	{
+		error = pdf_writexrefindex(xref, indexname, key);
+		if (error)
+			fz_catch(error, "cannot write xref index '%s'", indexname);
+	}
+
 	*xrefp = xref;
 	return fz_okay;
 }
 
+fz_error
+pdf_openxrefwithstream(pdf_xref **xrefp, fz_stream *file, char *password)
+{
+	return pdf_openxrefwithkey(xrefp, file, password, nil, nil);
+}
+
 void
 pdf_freexref(pdf_xref *xref)
 {
@@ -660,6 +1027,11 @@ pdf_freexref(pdf_xref *xref)
 	if (xref->store)
 		pdf_freestore(xref->store);
 
+	pdf_freestreamcache(xref);
+	pdf_freecodecache(xref);
+	pdf_freexrefsections(xref);
+	pdf_freexrefindex(xref);
+
 	if (xref->table)
 	{
 		for (i = 0; i < xref->len; i++)
@@ -672,18 +1044,21 @@ pdf_freexref(pdf_xref *xref)
 		}
 		fz_free(xref->table);
 	}
+	fz_free(xref->agelist);
 
 	if (xref->pageobjs)
 	{
 		for (i = 0; i < xref->pagelen; i++)
-			fz_dropobj(xref->pageobjs[i]);
+			if (xref->pageobjs[i])
+				fz_dropobj(xref->pageobjs[i]);
 		fz_free(xref->pageobjs);
 	}
 
 	if (xref->pagerefs)
 	{
 		for (i = 0; i < xref->pagelen; i++)
-			fz_dropobj(xref->pagerefs[i]);
+			if (xref->pagerefs[i])
+				fz_dropobj(xref->pagerefs[i]);
 		fz_free(xref->pagerefs);
 	}
 
@@ -700,11 +1075,17 @@ pdf_freexref(pdf_xref *xref)
 void
 pdf_debugxref(pdf_xref *xref)
 {
+	fz_error error;
 	int i;
+
+	error = pdf_loadlazyxref(xref);
+	if (error)
+		fz_catch(error, "cannot load rest of xref");
+
 	printf("xref\n0 %d\n", xref->len);
 	for (i = 0; i < xref->len; i++)
 	{
-		printf("%05d: %010d %05d %c (refs=%d, stmofs=%d)\n", i,
+		printf("%05d: %010lld %05d %c (refs=%d, stmofs=%lld)\n", i,
 			xref->table[i].ofs,
 			xref->table[i].gen,
 			xref->table[i].type ? xref->table[i].type : '-',
@@ -776,7 +1157,7 @@ pdf_loadobjstm(pdf_xref *xref, int num, int gen, char *buf, int cap)
 
 	for (i = 0; i < count; i++)
 	{
-		fz_seek(stm, first + ofsbuf[i], 0);
+		fz_seek(stm, first + (fz_off_t)ofsbuf[i], 0);
 
 		error = pdf_parsestmobj(&obj, xref, stm, buf, cap);
 		if (error)
@@ -792,10 +1173,20 @@ pdf_loadobjstm(pdf_xref *xref, int num, int gen, char *buf, int cap)
 			goto cleanupstm;
 		}
 
-		if (xref->table[numbuf[i]].type == 'o' && xref->table[numbuf[i]].ofs == num)
+		/* the other objects in the stream will be asked for soon */
+		if (xref->table[numbuf[i]].type == 0 && xref->sections)
+		{
+			error = pdf_readxrefentry(xref, numbuf[i]);
+			if (error)
+				fz_catch(error, "ignoring broken xref entry (%d 0 R)", numbuf[i]);
+		}
+		if (xref->table[numbuf[i]].type == 0 && xref->index)
+			pdf_readindexentry(xref, numbuf[i]);
+
+		/* objects still cached from an earlier load may be in use */
+		if (xref->table[numbuf[i]].type == 'o' && xref->table[numbuf[i]].ofs == num &&
+			!xref->table[numbuf[i]].obj)
 		{
-			if (xref->table[numbuf[i]].obj)
-				fz_dropobj(xref->table[numbuf[i]].obj);
 			xref->table[numbuf[i]].obj = obj;
 		}
 		else
@@ -836,7 +1227,31 @@ pdf_cacheobject(pdf_xref *xref, int num, int gen)
 	x = &xref->table[num];
 
 	if (x->obj)
+	{
+		if (x->age > 0)
+			x->age = 0;
 		return fz_okay;
+	}
+
+	if (x->type == 0 && xref->sections)
+	{
+		error = pdf_readxrefentry(xref, num);
+		if (error)
+		{
+			fz_catch(error, "trying to repair");
+			error = pdf_repairlazyxref(xref);
+			if (error)
+				return fz_rethrow(error, "cannot find object (%d %d R)", num, gen);
+
+			/* the table may have moved, and the object been loaded */
+			x = &xref->table[num];
+			if (x->obj)
+				return fz_okay;
+		}
+	}
+
+	if (x->type == 0 && xref->index)
+		pdf_readindexentry(xref, num);
 
 	if (x->type == 'f')
 	{
@@ -857,6 +1272,14 @@ pdf_cacheobject(pdf_xref *xref, int num, int gen)
 
 		if (xref->crypt)
 			pdf_cryptobj(xref->crypt, x->obj, num, gen);
+
+		if (xref->agelen == xref->agecap)
+		{
+			xref->agecap = xref->agecap * 2 + 256;
+			xref->agelist = fz_realloc(xref->agelist, xref->agecap, sizeof(int));
+		}
+		xref->agelist[xref->agelen++] = num;
+		x->age = 0;
 	}
 	else if (x->type == 'o')
 	{
@@ -865,6 +1288,7 @@ pdf_cacheobject(pdf_xref *xref, int num, int gen)
 			error = pdf_loadobjstm(xref, x->ofs, 0, xref->scratch, sizeof xref->scratch);
 			if (error)
 				return fz_rethrow(error, "cannot load object stream containing object (%d %d R)", num, gen);
+			x = &xref->table[num];
 			if (!x->obj)
 				return fz_throw("object (%d %d R) was not found in its object stream", num, gen);
 		}
@@ -907,12 +1331,80 @@ pdf_updateobject(pdf_xref *xref, int num, int gen, fz_obj *newobj)
 
 	x = &xref->table[num];
 
+	pdf_uncachestream(xref, num, gen);
+
 	if (x->obj)
 		fz_dropobj(x->obj);
 
 	x->obj = fz_keepobj(newobj);
 	x->type = 'n';
 	x->ofs = 0;
+	x->age = -1;
+}
+
+/*
+ * Drop the objects that only the xref holds and that have not been
+ * asked for in the last maxage sweeps, so that long sessions run in
+ * bounded memory. Objects read from a file offset are parsed again
+ * when they are next asked for. Objects from object streams, and
+ * objects that were changed, are kept.
+ *
+ * A sweep is only made once a quarter more objects have been parsed
+ * than were left by the last one, so the cost stays in proportion to
+ * the objects that are loaded. The pointers returned by
+ * fz_resolveindirect are not counted, so like pdf_agestore this is
+ * only to be called between pages.
+ */
+void
+pdf_agexref(pdf_xref *xref, int maxage)
+{
+	pdf_xrefentry *x;
+	int i, n, num;
+
+	if (xref->agelen - xref->agemark < MAX(xref->agemark / 4, 64))
+		return;
+
+	n = 0;
+	for (i = 0; i < xref->agelen; i++)
+	{
+		num = xref->agelist[i];
+		if (num >= xref->len)
+			continue;
+
+		x = &xref->table[num];
+		if (x->type != 'n' || !x->obj || x->age < 0)
+			continue;
+
+		if (x->obj->refs == 1 && ++x->age > maxage)
+		{
+			fz_dropobj(x->obj);
+			x->obj = nil;
+			x->age = 0;
+			continue;
+		}
+
+		xref->agelist[n++] = num;
+	}
+	xref->agelen = n;
+	xref->agemark = n;
+}
+
+/*
+ * Open a document from a byte source of any kind.
+ */
+
+fz_error
+pdf_openxrefwithsource(pdf_xref **xrefp, fz_source *src, char *password)
+{
+	fz_error error;
+	fz_stream *file;
+
+	file = fz_opensource(src);
+	error = pdf_openxrefwithstream(xrefp, file, password);
+	fz_close(file);
+	if (error)
+		return fz_rethrow(error, "cannot load document from source");
+	return fz_okay;
 }
 
 /*
@@ -940,3 +1432,37 @@ pdf_openxref(pdf_xref **xrefp, char *filename, char *password)
 	*xrefp = xref;
 	return fz_okay;
 }
+
+/*
+ * Open a file with an xref index kept in another file next to it.
+ */
+
+fz_error
+pdf_openxrefwithindex(pdf_xref **xrefp, char *filename, char *password, char *indexname)
+{
+	fz_error error;
+	pdf_indexkey key;
+	pdf_xref *xref;
+	fz_stream *file;
+	int fd;
+
+	fd = open(filename, O_BINARY | O_RDONLY);
+	if (fd < 0)
+		return fz_throw("cannot open file '%s': %s", filename, strerror(errno));
+
+	error = pdf_makeindexkey(&key, fd);
+	if (error)
+	{
+		close(fd);
+		return fz_rethrow(error, "cannot load document '%s'", filename);
+	}
+
+	file = fz_openfile(fd);
+	error = pdf_openxrefwithkey(&xref, file, password, indexname, &key);
+	fz_close(file);
+	if (error)
+		return fz_rethrow(error, "cannot load document '%s'", filename);
+
+	*xrefp = xref;
+	return fz_okay;
+}
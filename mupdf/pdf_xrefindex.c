@@ -0,0 +1,477 @@
+#include "fitz.h"
+#include "mupdf.h"
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#endif
+
+/*
+ * An xref index is a file kept next to a document that holds what
+ * opening it found: the resolved xref table with object stream
+ * membership, the trailer, the lengths that repair had to correct,
+ * and the list of page objects. Opening the document again with the
+ * index skips reading the xref chain, repairing and walking the page
+ * tree.
+ *
+ * The index is tied to the document by its size, its modification
+ * time and a hash of its last kilobyte, where the trailer is. An index
+ * that does not match is ignored and written again.
+ *
+ * All numbers are little-endian and every record is aligned to eight
+ * bytes, so the file is used straight from a memory mapping and an
+ * entry or page is only looked at when it is first asked for:
+ *
+ *	header	"MUPDFIDX", version, key, pdf version, startxref,
+ *		linearized first page, entry, fixup and page counts
+ *	entry	ofs (8), stmofs (8), gen (4), type (1), padding (3)
+ *	fixup	object number (4), stream length (4)
+ *	page	object number (4), generation (4)
+ *	trailer	as text, to the end of the file
+ */
+
+enum
+{
+	PDF_INDEXVERSION = 1,
+	PDF_INDEXHEADER = 72,
+	PDF_INDEXENTRY = 24,
+	PDF_INDEXFIXUP = 8,
+	PDF_INDEXPAGE = 8,
+	PDF_INDEXTAIL = 1024,
+	PDF_INDEXNOPAGES = -1
+};
+
+static void
+putu32(unsigned char *p, unsigned int v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static void
+putu64(unsigned char *p, unsigned long long v)
+{
+	putu32(p, v);
+	putu32(p + 4, v >> 32);
+}
+
+static unsigned int
+getu32(unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static unsigned long long
+getu64(unsigned char *p)
+{
+	return getu32(p) | ((unsigned long long)getu32(p + 4) << 32);
+}
+
+/*
+ * The key of a document: its size and modification time, and an
+ * FNV-1a hash of the last kilobyte. Any change that is saved to the
+ * file appends a new trailer there, so it changes the hash even if
+ * the size and time happen to stay the same.
+ */
+fz_error
+pdf_makeindexkey(pdf_indexkey *key, int fd)
+{
+	unsigned char buf[PDF_INDEXTAIL];
+	struct stat info;
+	unsigned int hash;
+	int i, n;
+
+	if (fstat(fd, &info) < 0)
+		return fz_throw("cannot stat file: %s", strerror(errno));
+
+	key->filesize = info.st_size;
+	key->mtime = info.st_mtime;
+
+	if (lseek(fd, MAX(0, key->filesize - PDF_INDEXTAIL), 0) < 0)
+		return fz_throw("cannot seek in file: %s", strerror(errno));
+	n = read(fd, buf, sizeof buf);
+	if (n < 0)
+		return fz_throw("cannot read from file: %s", strerror(errno));
+	lseek(fd, 0, 0);
+
+	hash = 2166136261U;
+	for (i = 0; i < n; i++)
+	{
+		hash ^= buf[i];
+		hash *= 16777619U;
+	}
+	key->hash = hash;
+
+	return fz_okay;
+}
+
+struct pdf_xrefindex_s
+{
+	fz_buffer *buf;
+	unsigned char *entries;
+	unsigned char *pages;
+};
+
+/*
+ * Set an entry from the index the first time its object is asked for,
+ * as pdf_readxrefentry does for the xref sections. An entry that does
+ * not make sense is left unset: only objects in the file have streams,
+ * and objects in streams name another object in the table.
+ */
+void
+pdf_readindexentry(pdf_xref *xref, int num)
+{
+	pdf_xrefentry *x = &xref->table[num];
+	unsigned char *p = xref->index->entries + num * PDF_INDEXENTRY;
+	fz_off_t ofs = getu64(p);
+	fz_off_t stmofs = getu64(p + 8);
+
+	switch (p[20])
+	{
+	case 'f':
+		if (stmofs != 0)
+			return;
+		break;
+	case 'n':
+		if (ofs < 0 || stmofs < 0)
+			return;
+		break;
+	case 'o':
+		if (ofs < 1 || ofs >= xref->len || ofs == num || stmofs != 0)
+			return;
+		break;
+	default:
+		return;
+	}
+
+	x->ofs = ofs;
+	x->stmofs = stmofs;
+	x->gen = getu32(p + 16);
+	x->type = p[20];
+}
+
+/*
+ * Make a reference to a page in the index page list.
+ */
+fz_obj *
+pdf_loadindexpage(pdf_xref *xref, int i)
+{
+	unsigned char *p;
+
+	if (!xref->index || !xref->index->pages)
+		return nil;
+
+	p = xref->index->pages + i * PDF_INDEXPAGE;
+	return fz_newindirect(getu32(p), getu32(p + 4), xref);
+}
+
+void
+pdf_freexrefindex(pdf_xref *xref)
+{
+	if (xref->index)
+	{
+		fz_dropbuffer(xref->index->buf);
+		fz_free(xref->index);
+		xref->index = nil;
+	}
+}
+
+/*
+ * Take the xref from an index. The index stays mapped and the entries
+ * and pages are read from it as they are asked for. Returns 0 and
+ * leaves the xref as it was if there is no index or it belongs to
+ * another version of the document.
+ */
+int
+pdf_readxrefindex(pdf_xref *xref, char *indexname, pdf_indexkey *key)
+{
+	fz_error error;
+	fz_buffer *buf, *view;
+	fz_stream *stm;
+	fz_obj *trailer, *dict, *length;
+	unsigned char *p, *entries, *fixups, *pages;
+	int fd, len, nfixups, npages, num, i;
+	fz_off_t end;
+
+	fd = open(indexname, O_BINARY | O_RDONLY);
+	if (fd < 0)
+		return 0;
+	buf = fz_mapfile(fd);
+	close(fd);
+	if (!buf)
+		return 0;
+
+	p = buf->data;
+	if (buf->len < PDF_INDEXHEADER || memcmp(p, "MUPDFIDX", 8) != 0 ||
+		getu32(p + 8) != PDF_INDEXVERSION)
+	{
+		fz_warn("ignoring xref index '%s' of unknown format", indexname);
+		fz_dropbuffer(buf);
+		return 0;
+	}
+
+	if ((fz_off_t)getu64(p + 16) != key->filesize ||
+		(long long)getu64(p + 24) != key->mtime ||
+		getu32(p + 32) != key->hash)
+	{
+		pdf_logxref("xref index '%s' is out of date\n", indexname);
+		fz_dropbuffer(buf);
+		return 0;
+	}
+
+	len = getu32(p + 52);
+	nfixups = getu32(p + 56);
+	npages = getu32(p + 60);
+
+	end = PDF_INDEXHEADER;
+	end += (fz_off_t)len * PDF_INDEXENTRY;
+	end += (fz_off_t)nfixups * PDF_INDEXFIXUP;
+	if (npages != PDF_INDEXNOPAGES)
+		end += (fz_off_t)npages * PDF_INDEXPAGE;
+	if (len < 1 || nfixups < 0 || npages < PDF_INDEXNOPAGES || end > buf->len)
+	{
+		fz_warn("ignoring broken xref index '%s'", indexname);
+		fz_dropbuffer(buf);
+		return 0;
+	}
+
+	entries = p + PDF_INDEXHEADER;
+	fixups = entries + len * PDF_INDEXENTRY;
+	pages = fixups + nfixups * PDF_INDEXFIXUP;
+
+	/* the first object is free, as pdf_loadxref checks */
+	if (entries[20] != 'f')
+	{
+		fz_warn("ignoring broken xref index '%s'", indexname);
+		fz_dropbuffer(buf);
+		return 0;
+	}
+
+	view = fz_newbufferview(buf, end, buf->len - end);
+	stm = fz_openbuffer(view);
+	error = pdf_parsestmobj(&trailer, xref, stm, xref->scratch, sizeof xref->scratch);
+	fz_close(stm);
+	fz_dropbuffer(view);
+	if (error || !fz_isdict(trailer))
+	{
+		if (error)
+			fz_catch(error, "cannot parse trailer");
+		else
+			fz_dropobj(trailer);
+		fz_warn("ignoring broken xref index '%s'", indexname);
+		fz_dropbuffer(buf);
+		return 0;
+	}
+
+	pdf_logxref("load xref index '%s'\n", indexname);
+
+	xref->version = getu32(p + 36);
+	xref->startxref = getu64(p + 40);
+	xref->filesize = key->filesize;
+	xref->linpage = getu32(p + 48);
+	xref->trailer = trailer;
+
+	xref->index = fz_malloc(sizeof(pdf_xrefindex));
+	xref->index->buf = buf;
+	xref->index->entries = entries;
+	xref->index->pages = npages != PDF_INDEXNOPAGES ? pages : nil;
+
+	pdf_resizexref(xref, len);
+	pdf_readindexentry(xref, 0);
+
+	/* stream lengths corrected by repair, kept as pdf_repairxref does */
+	for (i = 0; i < nfixups; i++)
+	{
+		p = fixups + i * PDF_INDEXFIXUP;
+		num = getu32(p);
+		if (num <= 0 || num >= len || (int)getu32(p + 4) < 0)
+			continue;
+
+		pdf_readindexentry(xref, num);
+		error = pdf_loadobject(&dict, xref, num, xref->table[num].gen);
+		if (error)
+		{
+			fz_catch(error, "cannot load stream object (%d %d R)", num, xref->table[num].gen);
+			continue;
+		}
+
+		length = fz_newint(getu32(p + 4));
+		fz_dictputs(dict, "Length", length);
+		fz_dropobj(length);
+
+		xref->table[num].age = -1;
+
+		fz_dropobj(dict);
+	}
+
+	if (npages != PDF_INDEXNOPAGES)
+	{
+		xref->pagelen = npages;
+		xref->pagecap = npages;
+		xref->pagerefs = fz_calloc(npages, sizeof(fz_obj*));
+		xref->pageobjs = fz_calloc(npages, sizeof(fz_obj*));
+		memset(xref->pagerefs, 0, npages * sizeof(fz_obj*));
+		memset(xref->pageobjs, 0, npages * sizeof(fz_obj*));
+		xref->indexpages = 1;
+	}
+
+	return 1;
+}
+
+/*
+ * Collect the page list for the index. Nothing is written if
+ * a page cannot be found or is not an indirect object.
+ */
+static int *
+pdf_indexpagelist(pdf_xref *xref, int *npagesp)
+{
+	fz_error error;
+	fz_obj *ref;
+	int *list;
+	int i, n;
+
+	error = pdf_loadpagetree(xref);
+	if (error)
+	{
+		fz_catch(error, "cannot load page tree");
+		return nil;
+	}
+
+	n = pdf_getpagecount(xref);
+	list = fz_calloc(MAX(n, 1) * 2, sizeof(int));
+	for (i = 0; i < n; i++)
+	{
+		ref = pdf_getpageref(xref, i + 1);
+		if (!fz_isindirect(ref))
+		{
+			fz_free(list);
+			return nil;
+		}
+		list[i * 2] = fz_tonum(ref);
+		list[i * 2 + 1] = fz_togen(ref);
+	}
+
+	*npagesp = n;
+	return list;
+}
+
+static int
+pdf_isindexfixup(pdf_xref *xref, int num)
+{
+	pdf_xrefentry *x = &xref->table[num];
+	return x->type == 'n' && x->age == -1 && x->stmofs && x->obj &&
+		fz_isint(fz_dictgets(x->obj, "Length"));
+}
+
+/*
+ * Write the index of an opened document. It is written to a file of
+ * its own first and renamed over the old one, so that other processes
+ * never see half of it.
+ */
+fz_error
+pdf_writexrefindex(pdf_xref *xref, char *indexname, pdf_indexkey *key)
+{
+	fz_error error;
+	unsigned char head[PDF_INDEXHEADER];
+	unsigned char rec[PDF_INDEXENTRY];
+	char tmpname[1024];
+	pdf_xrefentry *x;
+	int *pages;
+	int nfixups, npages, i;
+	FILE *fp;
+
+	error = pdf_loadlazyxref(xref);
+	if (error)
+		return fz_rethrow(error, "cannot load xref");
+
+	npages = PDF_INDEXNOPAGES;
+	pages = pdf_indexpagelist(xref, &npages);
+
+	nfixups = 0;
+	for (i = 0; i < xref->len; i++)
+		if (pdf_isindexfixup(xref, i))
+			nfixups ++;
+
+	pdf_logxref("write xref index '%s'\n", indexname);
+
+	snprintf(tmpname, sizeof tmpname, "%s.%d", indexname, (int)getpid());
+	fp = fopen(tmpname, "wb");
+	if (!fp)
+	{
+		fz_free(pages);
+		return fz_throw("cannot create file '%s': %s", tmpname, strerror(errno));
+	}
+
+	memset(head, 0, sizeof head);
+	memcpy(head, "MUPDFIDX", 8);
+	putu32(head + 8, PDF_INDEXVERSION);
+	putu64(head + 16, key->filesize);
+	putu64(head + 24, key->mtime);
+	putu32(head + 32, key->hash);
+	putu32(head + 36, xref->version);
+	putu64(head + 40, xref->startxref);
+	putu32(head + 48, xref->linpage);
+	putu32(head + 52, xref->len);
+	putu32(head + 56, nfixups);
+	putu32(head + 60, npages);
+	fwrite(head, 1, sizeof head, fp);
+
+	for (i = 0; i < xref->len; i++)
+	{
+		x = &xref->table[i];
+		memset(rec, 0, sizeof rec);
+		putu64(rec, x->ofs);
+		putu64(rec + 8, x->stmofs);
+		putu32(rec + 16, x->gen);
+		rec[20] = x->type;
+		fwrite(rec, 1, PDF_INDEXENTRY, fp);
+	}
+
+	for (i = 0; i < xref->len; i++)
+	{
+		if (!pdf_isindexfixup(xref, i))
+			continue;
+		putu32(rec, i);
+		putu32(rec + 4, fz_toint(fz_dictgets(xref->table[i].obj, "Length")));
+		fwrite(rec, 1, PDF_INDEXFIXUP, fp);
+	}
+
+	for (i = 0; i < npages; i++)
+	{
+		putu32(rec, pages[i * 2]);
+		putu32(rec + 4, pages[i * 2 + 1]);
+		fwrite(rec, 1, PDF_INDEXPAGE, fp);
+	}
+
+	fz_fprintobj(fp, xref->trailer, 1);
+
+	fz_free(pages);
+
+	i = ferror(fp);
+	if (fclose(fp) != 0 || i)
+	{
+		remove(tmpname);
+		return fz_throw("cannot write file '%s'", tmpname);
+	}
+
+	if (rename(tmpname, indexname) < 0)
+	{
+		/* windows will not rename over a file that exists */
+		remove(indexname);
+		if (rename(tmpname, indexname) < 0)
+		{
+			remove(tmpname);
+			return fz_throw("cannot rename '%s' to '%s': %s", tmpname, indexname, strerror(errno));
+		}
+	}
+
+	/* the page list is complete, so keep it as if it came from the index */
+	if (npages != PDF_INDEXNOPAGES)
+		xref->indexpages = 1;
+
+	return fz_okay;
+}
@@ -0,0 +1,101 @@
+#!/bin/sh
+#
+# Check that files larger than 4 GB open and render.
+#
+# Writes a sparse two page PDF whose second page, page tree entry
+# and xref table all live past the 4 GB mark, then renders the last
+# page with pdfdraw. Needs a file system with sparse file support.
+#
+# usage: scripts/largefile.sh [path/to/pdfdraw]
+#
+
+PDFDRAW=${1:-build/debug/pdfdraw}
+TMP=${TMPDIR:-/tmp}/largefile.$$
+PDF=$TMP/large.pdf
+GAP=4831838208	# 4.5 GB
+
+if [ ! -x "$PDFDRAW" ]; then
+	echo "largefile: cannot find $PDFDRAW" >&2
+	exit 2
+fi
+
+mkdir -p $TMP || exit 2
+trap 'rm -rf $TMP' 0 1 2 15
+
+# emit appends a string to the file and advances the offset counter
+off=0
+emit()
+{
+	printf '%s' "$1" >> $PDF
+	off=$(($off + ${#1}))
+}
+
+: > $PDF
+emit "%PDF-1.4
+"
+o1=$off
+emit "1 0 obj
+<< /Type /Catalog /Pages 2 0 R >>
+endobj
+"
+o3=$off
+emit "3 0 obj
+<< /Type /Page /Parent 2 0 R /MediaBox [0 0 200 200] >>
+endobj
+"
+
+# the rest of the file starts after the hole
+truncate -s $GAP $PDF || exit 2
+off=$GAP
+
+page="0 0 1 rg 20 20 160 160 re f
+"
+o2=$off
+emit "2 0 obj
+<< /Type /Pages /Kids [3 0 R 4 0 R] /Count 2 >>
+endobj
+"
+o4=$off
+emit "4 0 obj
+<< /Type /Page /Parent 2 0 R /MediaBox [0 0 200 200] /Contents 5 0 R >>
+endobj
+"
+o5=$off
+emit "5 0 obj
+<< /Length ${#page} >>
+stream
+${page}endstream
+endobj
+"
+ox=$off
+emit "xref
+0 6
+$(printf '%010d %05d f \n' 0 65535)
+$(printf '%010d %05d n \n' $o1 0 $o2 0 $o3 0 $o4 0 $o5 0)
+trailer
+<< /Size 6 /Root 1 0 R >>
+startxref
+$ox
+%%EOF
+"
+
+"$PDFDRAW" -o $TMP/out.pgm $PDF 2 2>$TMP/err
+rc=$?
+if [ $rc -ne 0 ]; then
+	cat $TMP/err >&2
+	echo "largefile: pdfdraw failed with exit code $rc" >&2
+	exit 1
+fi
+# a warning here means the xref was not read and the file was repaired
+if [ -s $TMP/err ]; then
+	cat $TMP/err >&2
+	echo "largefile: pdfdraw reported errors" >&2
+	exit 1
+fi
+if [ ! -s $TMP/out.pgm ]; then
+	echo "largefile: pdfdraw wrote no output" >&2
+	exit 1
+fi
+
+echo "largefile: ok"
+exit 0